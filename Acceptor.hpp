@@ -5,6 +5,10 @@
 
 #include "Socket.hpp"
 #include "EventLoop.hpp"
+#include <functional>
+
+#define ACCEPT_BATCH 64     //一次可读事件最多获取的新连接个数，避免连接风暴时长时间占用baseloop
+#define ACCEPT_RETRY_MS 100 //accept遇到无法立即处理的错误时，暂停监控这么长时间后重试
 
 
 class Acceptor {
@@ -12,20 +16,82 @@ private:
     Socket _socket;//用于创建监听套接字
     EventLoop *_loop; //用于对监听套接字进行事件监控
     Channel _channel; //用于对监听套接字进行事件管理
+    int _idle_fd;     //预留的空闲描述符，描述符耗尽时用来取出并关闭新连接
+    int _accept_batch;//一次可读事件最多获取的新连接个数
+    bool _retry_pending;//已经暂停监控，等待重试
 
     using AcceptCallback = std::function<void(int)>;
     AcceptCallback _accept_callback;
 private:
     /*监听套接字的读事件回调处理函数---获取新连接，调用_accept_callback函数进行新连接处理*/
+    //一直获取到没有新连接为止，每次最多获取_accept_batch个
     void HandleRead() {
-        int newfd = _socket.Accept();
-        if (newfd < 0) {
+        if (_retry_pending) return ;
+        for (int i = 0; i < _accept_batch; i++) {
+            int newfd = _socket.Accept();
+            if (newfd < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return ;
+                if (errno == EMFILE || errno == ENFILE) {
+                    //描述符耗尽时即使监听队列为空accept也会失败，取不到连接说明队列已经空了
+                    if (!DropPending()) return ;
+                    continue;
+                }
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                //其他错误(比如ENOBUFS、ENOMEM)不能直接返回：边缘触发下监听队列里的连接不会再有通知
+                ERR_LOG("ACCEPT FAILED:%s, RETRY IN %dms", strerror(errno), ACCEPT_RETRY_MS);
+                ScheduleRetry();
+                return ;
+            }
+            if (_accept_callback) _accept_callback(newfd);
+        }
+        //达到单次上限，监听队列中可能还有新连接。水平触发下epoll会再次通知，边缘触发不会，放到任务池中继续获取
+        if (_channel.EdgeTriggered()) _loop->QueueInLoop([this] { HandleRead(); });
+    }
+    //io_uring完成的multishot accept，每个新连接一个完成事件，不受单次上限的限制
+    //出错时请求已经结束：描述符耗尽先取出一个连接关闭，和其他错误一样暂停一段时间再重新提交，避免错误一直存在时不停重试
+    void HandleAccepted(int res) {
+        if (res >= 0) {
+            if (_accept_callback) _accept_callback(res);
             return ;
         }
-        if (_accept_callback) _accept_callback(newfd);
+        if (res == -EINTR || res == -ECONNABORTED) return ;//请求结束后会立即重新提交
+        if (res == -EMFILE || res == -ENFILE) {
+            DropPending();
+        }else {
+            ERR_LOG("ACCEPT FAILED:%s, RETRY IN %dms", strerror(-res), ACCEPT_RETRY_MS);
+        }
+        ScheduleRetry();
+    }
+    //暂停监控，避免水平触发下错误一直存在时不停触发；稍后恢复监控并主动获取一次，边缘触发下也不会漏掉队列中的连接
+    void ScheduleRetry() {
+        _retry_pending = true;
+        _channel.DisableRead();
+        _loop->RunAfter(std::chrono::milliseconds(ACCEPT_RETRY_MS), [this] {
+            _retry_pending = false;
+            if (_socket.Fd() < 0) return ;//已经关闭
+            _channel.EnableRead();
+            HandleRead();
+        });
+    }
+    //描述符耗尽，新连接一直留在监听队列里会导致可读事件不停触发
+    //先关闭预留的描述符腾出位置，把连接取出来直接关闭，再重新预留
+    //返回是否取出了一个连接
+    bool DropPending() {
+        if (_idle_fd >= 0) close(_idle_fd);
+        int fd = accept(_socket.Fd(), NULL, NULL);
+        if (fd >= 0) {
+            ERR_LOG("TOO MANY OPEN FILES, DROP NEW CONNECTION!");
+            close(fd);
+        }
+        _idle_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        return fd >= 0;
     }
+    //只创建套接字和绑定地址，Listen时才开始监听，没有开始监听的套接字不会接收任何连接
     int CreateServer(int port) {
-        bool ret = _socket.CreateServer(port);
+        bool ret = _socket.Create();
+        assert(ret);
+        _socket.ReuseAddress();
+        ret = _socket.Bind("0.0.0.0", port);
         assert(ret);
         return _socket.Fd();
     }
@@ -33,9 +99,32 @@ public:
     /*不能将启动读事件监控，放到构造函数中，必须在设置回调函数后，再去启动*/
     /*否则有可能造成启动监控后，立即有事件，处理的时候，回调函数还没设置：新连接得不到处理，且资源泄漏*/
     Acceptor(EventLoop *loop, int port): _socket(CreateServer(port)), _loop(loop),
-                                         _channel(loop, _socket.Fd()) {
+                                         _channel(loop, _socket.Fd()),
+                                         _idle_fd(open("/dev/null", O_RDONLY | O_CLOEXEC)),
+                                         _accept_batch(ACCEPT_BATCH), _retry_pending(false) {
+        //循环accept直到EAGAIN，监听套接字必须是非阻塞的
+        _socket.NonBlock();
         _channel.SetReadCallback([this] { HandleRead(); });
+        if (loop->AsyncIo()) {
+            _channel.SetIoMode(ChannelIo::ACCEPT);
+            _channel.SetAcceptedCallback([this](int res) { HandleAccepted(res); });
+        }
     }
+    ~Acceptor() { if (_idle_fd >= 0) close(_idle_fd); }
     void SetAcceptCallback(const AcceptCallback &cb) { _accept_callback = cb; }
-    void Listen() { _channel.EnableRead(); }
+    //开始监听并启动读事件监控，必须在所属EventLoop线程中调用
+    void Listen() {
+        bool ret = _socket.Listen();
+        assert(ret);
+        _channel.EnableRead();
+    }
+    //停止监听并关闭监听套接字，必须在所属EventLoop线程中调用
+    void Close() {
+        _channel.Remove();
+        _socket.Close();
+    }
+    //由io_uring完成accept时以下两个设置不起作用
+    void SetEdgeTriggered(bool on) { _channel.SetEdgeTriggered(on); }
+    //设置一次可读事件最多获取的新连接个数
+    void SetAcceptBatch(int n) { _accept_batch = n > 0 ? n : 1; }
 };
\ No newline at end of file
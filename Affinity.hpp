@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Log.hpp"
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+//EventLoop线程的CPU绑定方案
+struct LoopAffinity {
+    bool enable = false;        //是否绑定，不绑定时线程由内核调度
+    std::vector<int> cpus;      //第i个从属EventLoop绑定的CPU，为空时依次使用进程允许的CPU，数量不够时循环使用
+    int base_cpu = -1;          //baseloop绑定的CPU，-1表示不绑定；自动分配时从属EventLoop跳过这个CPU
+    bool numa_local = true;     //线程的内存优先从CPU所在的NUMA节点申请，内存池和缓冲区都是线程自己申请的
+};
+
+//CPU绑定和NUMA相关的系统接口，不依赖libnuma
+class Affinity {
+public:
+    //进程当前允许运行的CPU
+    static std::vector<int> AllowedCpus() {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) < 0) return cpus;
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &set)) cpus.push_back(i);
+        }
+        return cpus;
+    }
+    //从属EventLoop依次使用的CPU：指定了cpus时直接使用，否则依次使用allowed中除baseloop以外的CPU
+    //allowed必须在绑定baseloop之前读取，绑定之后当前线程允许的CPU只剩base_cpu一个
+    static std::vector<int> PlanLoopCpus(const LoopAffinity &affinity, const std::vector<int> &allowed) {
+        if (!affinity.enable) return {};
+        if (!affinity.cpus.empty()) return affinity.cpus;
+        std::vector<int> cpus;
+        for (int cpu : allowed) {
+            if (cpu != affinity.base_cpu) cpus.push_back(cpu);
+        }
+        //只有baseloop的一个CPU时只能共用
+        return cpus.empty() ? allowed : cpus;
+    }
+    //把当前线程绑定到cpu上
+    static bool PinThread(int cpu) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret != 0) {
+            ERR_LOG("PIN THREAD TO CPU %d FAILED:%s", cpu, strerror(ret));
+            return false;
+        }
+        return true;
+    }
+    //cpu所在的NUMA节点，没有NUMA信息时返回-1
+    static int CpuNode(int cpu) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+        DIR *dir = opendir(path);
+        if (dir == nullptr) return -1;
+        int node = -1;
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != nullptr) {
+            if (sscanf(ent->d_name, "node%d", &node) == 1) break;
+            node = -1;
+        }
+        closedir(dir);
+        return node;
+    }
+    //当前线程之后申请的内存优先放在node上，node上内存不够时使用其他节点
+    static bool PreferNode(int node) {
+        if (node < 0 || node >= (int)(sizeof(unsigned long) * 8)) return false;
+        unsigned long mask = 1UL << node;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) < 0) {
+            ERR_LOG("SET MEMPOLICY FAILED:%s", strerror(errno));
+            return false;
+        }
+        return true;
+    }
+    //绑定CPU，需要时同时设置内存策略，在线程创建任何数据之前调用
+    static void Apply(int cpu, bool numa_local) {
+        if (cpu < 0 || !PinThread(cpu)) return ;
+        if (numa_local) PreferNode(CpuNode(cpu));
+    }
+};
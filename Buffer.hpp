@@ -1,90 +1,367 @@
+#pragma once
+
+#include "Log.hpp"
+#include "MemoryPool.hpp"
+#include "Scanner.hpp"
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <sys/uio.h>
+
 #define BUFFER_DEFAULT_SIZE 1024
+#define BUFFER_SEGMENT_SIZE 4096    //链式模式下每个分段的固定大小
+#define BUFFER_MAX_IOVEC 1024       //一次readv/writev最多使用的iovec个数(IOV_MAX)
+#define BUFFER_LINE_CACHE 32        //一次扫描最多记录的换行位置个数
+#define BUFFER_SPLICE_MIN 1024      //转移所有权写入时，不超过这个大小的数据直接拷贝，避免链过于零碎
+
+//CONTIGUOUS -- 单块连续内存，空间不足时整体搬移或扩容；
+//CHAINED -- 由固定大小分段组成的链，追加数据时不搬移已有数据，可以直接readv/writev
+enum class BufferMode {
+    CONTIGUOUS,
+    CHAINED
+};
+
+//缓冲区收缩策略：容量超过max_capacity的缓冲区，在可读数据降到drain_threshold以下时立即收缩，
+//或者在连接连续idle_seconds秒没有活动时收缩；max_capacity为0表示不收缩，idle_seconds为0表示不做空闲收缩
+struct BufferShrinkPolicy {
+    uint64_t max_capacity = 1 << 20;
+    uint64_t drain_threshold = 0;
+    uint32_t idle_seconds = 0;
+};
+
+//服务器内所有连接共享的缓冲区配额，缓冲数据总量达到高水位后连接暂停读取，降到低水位以下再恢复
+class BufferQuota {
+private:
+    std::atomic<int64_t> _used;
+    uint64_t _high_watermark;
+    uint64_t _low_watermark;
+public:
+    BufferQuota(uint64_t high, uint64_t low):_used(0), _high_watermark(high), _low_watermark(low) {}
+    void Add(int64_t delta) { _used.fetch_add(delta, std::memory_order_relaxed); }
+    uint64_t Used() const { return std::max<int64_t>(_used.load(std::memory_order_relaxed), 0); }
+    bool Exceeded() const { return Used() >= _high_watermark; }
+    bool Recovered() const { return Used() < _low_watermark; }
+};
+
+//不可变的共享数据片，引用计数管理，多个连接发送同一份数据时不需要各自拷贝
+class Slice {
+private:
+    std::shared_ptr<const std::string> _data;
+    size_t _offset;
+    size_t _len;
+public:
+    Slice():_offset(0), _len(0) {}
+    explicit Slice(std::string &&data):_data(std::make_shared<const std::string>(std::move(data))),
+                                       _offset(0), _len(_data->size()) {}
+    explicit Slice(const std::string &data):_data(std::make_shared<const std::string>(data)),
+                                            _offset(0), _len(_data->size()) {}
+    const char *Data() const { return _data ? _data->data() + _offset : nullptr; }
+    size_t Size() const { return _len; }
+    const std::shared_ptr<const std::string> &Owner() const { return _data; }
+    //引用同一份数据中的一部分
+    Slice Sub(size_t offset, size_t len) const {
+        assert(offset + len <= _len);
+        Slice slice(*this);
+        slice._offset += offset;
+        slice._len = len;
+        return slice;
+    }
+};
+
 class Buffer {
 private:
-    std::vector<char> _buffer; 
-    uint64_t _reader_idx; 
-    uint64_t _writer_idx; 
+    //一块存储空间：从当前线程内存池申请，或者引用外部不可变的数据(_owner不为空，只读，不能再写入)
+    //自己申请的空间记住所属的内存池，缓冲区在其他线程析构时也还给申请它的线程
+    struct Segment {
+        char *_data;
+        uint64_t _capacity;
+        uint64_t _reader_idx;
+        uint64_t _writer_idx;
+        MemoryPool *_pool;
+        std::shared_ptr<const void> _owner;
+        explicit Segment(uint64_t capacity):_data(nullptr), _capacity(capacity), _reader_idx(0), _writer_idx(0),
+                                            _pool(&MemoryPool::Local()) {
+            _data = (char *)_pool->Allocate(capacity);
+        }
+        Segment(std::shared_ptr<const void> owner, const char *data, uint64_t len):
+                _data((char *)data), _capacity(len), _reader_idx(0), _writer_idx(len), _pool(nullptr),
+                _owner(std::move(owner)) {}
+        Segment(const Segment &other):_data(other._data), _capacity(other._capacity), _reader_idx(other._reader_idx),
+                                      _writer_idx(other._writer_idx), _pool(nullptr), _owner(other._owner) {
+            //外部数据只增加引用计数，自己的空间需要深拷贝
+            if (_owner) return;
+            _pool = &MemoryPool::Local();
+            _data = (char *)_pool->Allocate(_capacity);
+            std::copy(other._data + _reader_idx, other._data + _writer_idx, _data + _reader_idx);
+        }
+        Segment(Segment &&other) noexcept:_data(other._data), _capacity(other._capacity),
+                                          _reader_idx(other._reader_idx), _writer_idx(other._writer_idx),
+                                          _pool(other._pool), _owner(std::move(other._owner)) {
+            other._data = nullptr;
+            other._capacity = 0;
+        }
+        Segment &operator=(Segment other) noexcept {
+            std::swap(_data, other._data);
+            std::swap(_capacity, other._capacity);
+            std::swap(_reader_idx, other._reader_idx);
+            std::swap(_writer_idx, other._writer_idx);
+            std::swap(_pool, other._pool);
+            std::swap(_owner, other._owner);
+            return *this;
+        }
+        ~Segment() { if (!_owner && _pool) _pool->Deallocate(_data, _capacity); }
+        bool External() const { return _owner != nullptr; }
+        char *Begin() { return _data; }
+        char *ReadPosition() { return Begin() + _reader_idx; }
+        char *WritePosition() { return Begin() + _writer_idx; }
+        uint64_t ReadableSize() const { return _writer_idx - _reader_idx; }
+        uint64_t TailIdleSize() const { return External() ? 0 : _capacity - _writer_idx; }
+        //换一块更大的空间，可读数据搬到新空间的起始位置
+        void Resize(uint64_t capacity) {
+            Segment seg(capacity);
+            std::copy(ReadPosition(), WritePosition(), seg.Begin());
+            seg._writer_idx = ReadableSize();
+            *this = std::move(seg);
+        }
+    };
+    BufferMode _mode;
+    std::deque<Segment> _segments;  //至少有一个分段，连续模式下始终只有一个
+    uint64_t _readable;             //所有分段中可读数据的总长度
+    int _reserved;                  //ReserveWriteVecs预留的、还没有提交的尾部分段个数
+    //扫描结果记录为数据流中的绝对位置(_read_total是累计读走的字节数)，数据被读走或者合并都不影响
+    //部分数据到达时，下次从上次扫描结束的位置继续，不重复扫描
+    uint64_t _read_total;
+    std::vector<uint64_t> _lines;   //已经找到、还没有被读走的换行位置
+    size_t _line_idx;               //_lines中第一个有效的位置
+    uint64_t _line_scanned;         //查找换行已经扫描到的位置
+    uint64_t _header_scanned;       //查找空行已经扫描到的位置
+private:
+    Segment &Head() { return _segments.front(); }
+    Segment &Tail() { return _segments.back(); }
+    //链式模式的新分段，大块写入时分段可以超过标准大小
+    static Segment NewSegment(uint64_t len) {
+        return Segment(std::max<uint64_t>(len, BUFFER_SEGMENT_SIZE));
+    }
+    //在链尾挂上一个已经有数据的分段，空的尾部分段直接丢掉
+    void AppendSegment(Segment &&seg) {
+        if (seg.ReadableSize() == 0) return;
+        if (Tail().ReadableSize() == 0) _segments.pop_back();
+        _readable += seg.ReadableSize();
+        _segments.push_back(std::move(seg));
+    }
+    //把分散在多个分段中的可读数据合并到一个分段，给需要连续内存的调用者使用
+    void Coalesce() {
+        if (_segments.size() == 1) return;
+        Segment seg = NewSegment(_readable);
+        Read(seg.Begin(), _readable);
+        seg._writer_idx = _readable;
+        _segments.clear();
+        _segments.push_back(std::move(seg));
+    }
+    //从上次扫描结束的位置继续向后扫描，一次记录多个换行位置，后续的GetLine不需要再扫描
+    void ScanLines() {
+        _lines.clear();
+        _line_idx = 0;
+        uint64_t start = std::max(_line_scanned, _read_total);
+        const char *base = ReadPosition();
+        const char *from = base + (start - _read_total);
+        const char *stop = nullptr;
+        size_t offs[BUFFER_LINE_CACHE];
+        size_t n = Scanner::FindAll(from, base + ReadableSize(), '\n', offs, BUFFER_LINE_CACHE, &stop);
+        for (size_t i = 0; i < n; i++) {
+            _lines.push_back(start + offs[i]);
+        }
+        _line_scanned = start + (stop - from);
+    }
 public:
-    Buffer():_reader_idx(0), _writer_idx(0), _buffer(BUFFER_DEFAULT_SIZE){}
-    char *Begin() { return &*_buffer.begin(); }
-    
-    char *WritePosition() { return Begin() + _writer_idx; }
-    
-    char *ReadPosition() { return Begin() + _reader_idx; }
-    
-    uint64_t TailIdleSize() { return _buffer.size() - _writer_idx; }
-    
-    uint64_t HeadIdleSize() { return _reader_idx; }
-    
-    uint64_t ReadableSize() { return _writer_idx - _reader_idx; }
-    
+    explicit Buffer(BufferMode mode = BufferMode::CONTIGUOUS):_mode(mode), _readable(0), _reserved(0),
+                                                              _read_total(0), _line_idx(0), _line_scanned(0),
+                                                              _header_scanned(0) {
+        _segments.emplace_back(_mode == BufferMode::CHAINED ? BUFFER_SEGMENT_SIZE : BUFFER_DEFAULT_SIZE);
+    }
+
+    BufferMode Mode() const { return _mode; }
+
+    bool Chained() const { return _mode == BufferMode::CHAINED; }
+
+    char *Begin() { return Head().Begin(); }
+
+    char *WritePosition() { return Tail().WritePosition(); }
+    //链式模式下会先把数据合并成连续的一块
+    char *ReadPosition() { Coalesce(); return Head().ReadPosition(); }
+
+    uint64_t TailIdleSize() { return Tail().TailIdleSize(); }
+
+    uint64_t HeadIdleSize() { return Head()._reader_idx; }
+
+    uint64_t ReadableSize() { return _readable; }
+    //所有分段占用的空间
+    uint64_t Capacity() {
+        uint64_t cap = 0;
+        for (auto &seg : _segments) cap += seg._capacity;
+        return cap;
+    }
+    //释放多余的空间：连续模式缩回默认大小或者刚好容纳可读数据，链式模式把超大的分段换成标准分段
+    void Shrink() {
+        uint64_t min_cap = Chained() ? BUFFER_SEGMENT_SIZE : BUFFER_DEFAULT_SIZE;
+        for (auto &seg : _segments) {
+            uint64_t cap = std::max(seg.ReadableSize(), min_cap);
+            if (!seg.External() && seg._capacity > cap) seg.Resize(cap);
+        }
+    }
+
     void MoveReadOffset(uint64_t len) {
         if (len == 0) return;
-        
+
         assert(len <= ReadableSize());
-        _reader_idx += len;
+        _readable -= len;
+        _read_total += len;
+        while (len > 0) {
+            Segment &head = Head();
+            uint64_t n = std::min(len, head.ReadableSize());
+            head._reader_idx += n;
+            len -= n;
+            //读完的分段释放回内存池，最后一个分段保留用于继续写入
+            while (_segments.size() > 1 && Head().ReadableSize() == 0) _segments.pop_front();
+        }
+        if (Chained() && _readable == 0) {
+            Head()._reader_idx = 0;
+            Head()._writer_idx = 0;
+        }
     }
-    
+
     void MoveWriteOffset(uint64_t len) {
-        
+
         assert(len <= TailIdleSize());
-        _writer_idx += len;
+        Tail()._writer_idx += len;
+        _readable += len;
     }
-    
+
     void EnsureWriteSpace(uint64_t len) {
-        
+
         if (TailIdleSize() >= len) { return; }
-        
+
+        if (Chained()) {
+            //链式模式不搬移已有数据，尾部分段为空则直接替换，否则追加一个新分段
+            if (Tail().ReadableSize() == 0) {
+                Tail() = NewSegment(len);
+                return;
+            }
+            _segments.push_back(NewSegment(len));
+            return;
+        }
+
+        Segment &seg = Head();
         if (len <= TailIdleSize() + HeadIdleSize()) {
-            
+
             uint64_t rsz = ReadableSize();
             std::copy(ReadPosition(), ReadPosition() + rsz, Begin());
-            _reader_idx = 0;    
-            _writer_idx = rsz;  
+            seg._reader_idx = 0;
+            seg._writer_idx = rsz;
         }else {
-            
-            DBG_LOG("RESIZE %ld", _writer_idx + len);
-            _buffer.resize(_writer_idx + len);
+
+            DBG_LOG("RESIZE %ld", seg._writer_idx + len);
+            seg.Resize(std::max(seg._writer_idx + len, seg._capacity * 2));
         }
     }
-    
+
     void Write(const void *data, uint64_t len) {
-        
+
         if (len == 0) return;
         EnsureWriteSpace(len);
         const char *d = (const char *)data;
         std::copy(d, d + len, WritePosition());
     }
     void WriteAndPush(const void *data, uint64_t len) {
-        Write(data, len);
-        MoveWriteOffset(len);
+        if (!Chained()) {
+            Write(data, len);
+            MoveWriteOffset(len);
+            return;
+        }
+        //先填满尾部分段的空闲空间，剩下的数据依次写入新的分段
+        const char *d = (const char *)data;
+        while (len > 0) {
+            if (TailIdleSize() == 0) EnsureWriteSpace(std::min<uint64_t>(len, BUFFER_SEGMENT_SIZE));
+            uint64_t n = std::min(len, TailIdleSize());
+            std::copy(d, d + n, WritePosition());
+            MoveWriteOffset(n);
+            d += n;
+            len -= n;
+        }
     }
     void WriteString(const std::string &data) {
         return Write(data.c_str(), data.size());
     }
     void WriteStringAndPush(const std::string &data) {
-        WriteString(data);
-        MoveWriteOffset(data.size());
+        WriteAndPush(data.c_str(), data.size());
+    }
+    //转移字符串的所有权，链式模式下直接作为一个分段挂到链上，不拷贝数据
+    void WriteStringAndPush(std::string &&data) {
+        if (!Chained() || data.size() <= BUFFER_SPLICE_MIN) {
+            return WriteAndPush(data.c_str(), data.size());
+        }
+        auto owner = std::allocate_shared<const std::string>(PoolAllocator<std::string>(), std::move(data));
+        AppendSegment(Segment(owner, owner->data(), owner->size()));
+    }
+    //引用共享的不可变数据片，链式模式下只增加引用计数
+    void WriteSliceAndPush(const Slice &slice) {
+        if (!Chained() || slice.Size() <= BUFFER_SPLICE_MIN) {
+            return WriteAndPush(slice.Data(), slice.Size());
+        }
+        AppendSegment(Segment(slice.Owner(), slice.Data(), slice.Size()));
     }
     void WriteBuffer(Buffer &data) {
         return Write(data.ReadPosition(), data.ReadableSize());
     }
     void WriteBufferAndPush(Buffer &data) {
-        WriteBuffer(data);
-        MoveWriteOffset(data.ReadableSize());
+        //按分段逐个追加，不需要先把源缓冲区合并成连续内存
+        for (auto &seg : data._segments) {
+            WriteAndPush(seg.ReadPosition(), seg.ReadableSize());
+        }
+    }
+
+    //转移另一个缓冲区的所有分段，链式模式下大的分段直接挂到链上，小的分段拷贝进尾部分段，避免链过于零碎
+    void WriteBufferAndPush(Buffer &&data) {
+        if (!Chained()) {
+            WriteBufferAndPush(data);
+        }else {
+            for (auto &seg : data._segments) {
+                if (seg.ReadableSize() <= BUFFER_SPLICE_MIN) {
+                    WriteAndPush(seg.ReadPosition(), seg.ReadableSize());
+                }else {
+                    AppendSegment(std::move(seg));
+                }
+            }
+        }
+        data._segments.clear();
+        data._segments.emplace_back(data.Chained() ? BUFFER_SEGMENT_SIZE : BUFFER_DEFAULT_SIZE);
+        data._read_total += data._readable;
+        data._readable = 0;
     }
-    
+
     void Read(void *buf, uint64_t len) {
-        
+
         assert(len <= ReadableSize());
-        std::copy(ReadPosition(), ReadPosition() + len, (char*)buf);
+        char *out = (char *)buf;
+        for (auto &seg : _segments) {
+            if (len == 0) break;
+            uint64_t n = std::min(len, seg.ReadableSize());
+            std::copy(seg.ReadPosition(), seg.ReadPosition() + n, out);
+            out += n;
+            len -= n;
+        }
     }
     void ReadAndPop(void *buf, uint64_t len) {
         Read(buf, len);
         MoveReadOffset(len);
     }
     std::string ReadAsString(uint64_t len) {
-        
+
         assert(len <= ReadableSize());
         std::string str;
         str.resize(len);
@@ -98,8 +375,31 @@ public:
         return str;
     }
     char *FindCRLF() {
-        char *res = (char*)memchr(ReadPosition(), '\n', ReadableSize());
-        return res;
+        //丢掉已经被读走的换行位置，缓存用完了再继续扫描
+        while (_line_idx < _lines.size() && _lines[_line_idx] < _read_total) _line_idx++;
+        if (_line_idx == _lines.size()) {
+            ScanLines();
+            if (_lines.empty()) return NULL;
+        }
+        return ReadPosition() + (_lines[_line_idx] - _read_total);
+    }
+    //查找第一个空行(请求头结束的"\r\n\r\n"或者"\n\n")，返回空行之后的位置，没有找到返回NULL
+    //读位置被认为是一行的开头
+    char *FindHeaderEnd() {
+        uint64_t start = std::max(_header_scanned, _read_total);
+        char *base = ReadPosition();
+        char *end = base + ReadableSize();
+        //读位置之后的空行在之前的扫描中可能不是行首，单独判断
+        if (start > _read_total) {
+            if (base < end && base[0] == '\n') return base + 1;
+            if (base + 1 < end && base[0] == '\r' && base[1] == '\n') return base + 2;
+        }
+        const char *res = Scanner::FindEmptyLine(base, base + (start - _read_total), end);
+        if (res == nullptr) {
+            _header_scanned = _read_total + ReadableSize();
+            return NULL;
+        }
+        return (char *)res;
     }
 
     std::string GetLine() {
@@ -107,7 +407,7 @@ public:
         if (pos == NULL) {
             return "";
         }
-        
+
         return ReadAsString(pos - ReadPosition() + 1);
     }
     std::string GetLineAndPop() {
@@ -115,10 +415,60 @@ public:
         MoveReadOffset(str.size());
         return str;
     }
-    
+    //把可读数据按分段填入iovec，用于一次writev发送整条链，返回使用的iovec个数
+    int ReadVecs(struct iovec *iov, int max) {
+        int cnt = 0;
+        for (auto &seg : _segments) {
+            if (cnt >= max) break;
+            if (seg.ReadableSize() == 0) continue;
+            iov[cnt].iov_base = seg.ReadPosition();
+            iov[cnt].iov_len = seg.ReadableSize();
+            cnt++;
+        }
+        return cnt;
+    }
+    //为readv准备可写空间：尾部的空闲空间，链式模式下再加上若干个从内存池取出的新分段
+    //必须紧接着调用CommitWriteVecs提交实际读到的长度
+    int ReserveWriteVecs(struct iovec *iov, int max) {
+        assert(_reserved == 0 && max > 0);
+        int cnt = 0;
+        if (TailIdleSize() > 0) {
+            iov[cnt].iov_base = WritePosition();
+            iov[cnt].iov_len = TailIdleSize();
+            cnt++;
+        }
+        while (Chained() && cnt < max) {
+            _segments.emplace_back(BUFFER_SEGMENT_SIZE);
+            _reserved++;
+            iov[cnt].iov_base = Tail().WritePosition();
+            iov[cnt].iov_len = Tail().TailIdleSize();
+            cnt++;
+        }
+        return cnt;
+    }
+    //依次推进各个分段的写偏移，没有用到的预留分段还给内存池
+    void CommitWriteVecs(uint64_t len) {
+        _readable += len;
+        for (size_t i = _segments.size() - _reserved - 1; i < _segments.size() && len > 0; i++) {
+            Segment &seg = _segments[i];
+            uint64_t n = std::min(len, seg.TailIdleSize());
+            seg._writer_idx += n;
+            len -= n;
+        }
+        assert(len == 0);
+        while (_reserved > 0 && Tail().ReadableSize() == 0) {
+            _segments.pop_back();
+            _reserved--;
+        }
+        _reserved = 0;
+    }
+
     void Clear() {
-        
-        _reader_idx = 0;
-        _writer_idx = 0;
+
+        while (_segments.size() > 1) _segments.pop_back();
+        Head()._reader_idx = 0;
+        Head()._writer_idx = 0;
+        _read_total += _readable;
+        _readable = 0;
     }
-};
\ No newline at end of file
+};
@@ -1,11 +1,26 @@
 #pragma once
 
 #include <cstdint>
-#include <functional>
+#include "Function.hpp"
 #include <sys/epoll.h>
+#include <sys/types.h>
 
 class EventLoop;
 
+//Channel在Poller中的状态：NEW--没有添加过；ADDED--已经添加到epoll；DELETED--没有监控事件，暂时从epoll中移除了
+enum class ChannelState {
+    NEW,
+    ADDED,
+    DELETED
+};
+
+//读取的方式：READY--就绪通知，可读时在回调中自己调用accept/recv
+//ACCEPT/RECV--完成通知，Poller支持时(EventLoop::AsyncIo)由内核完成accept/recv，完成回调中直接拿到结果，不支持时和READY一样
+enum class ChannelIo {
+    READY,
+    ACCEPT,
+    RECV
+};
 
 class Channel {
 private:
@@ -13,22 +28,55 @@ private:
     EventLoop *_loop;
     uint32_t _events;  
     uint32_t _revents; 
-    using EventCallback = std::function<void()>;
+    bool _edge_triggered;   //是否使用边缘触发模式注册事件
+    ChannelState _state;    //由Poller维护，判断是否已经添加监控不需要查表
+    uint32_t _registered;   //由Poller维护，内核中当前注册的事件
+    bool _dirty;            //由Poller维护，监控事件有修改，还没有提交给内核
+    ChannelIo _io;          //读取的方式
+    using EventCallback = UniqueFunction<void()>;
+    using AcceptedCallback = UniqueFunction<void(int)>;                 //新连接的描述符，失败时是负的错误码
+    using ReceivedCallback = UniqueFunction<void(const char *, ssize_t)>;//收到的数据，0表示对端关闭，负数是错误码
+    using SentCallback = UniqueFunction<void(ssize_t, bool)>;           //发送出去的字节数或者错误码，以及这次发送是否全部结束
     EventCallback _read_callback;   
     EventCallback _write_callback;  
     EventCallback _error_callback;  
     EventCallback _close_callback;  
     EventCallback _event_callback;  
+    AcceptedCallback _accepted_callback;
+    ReceivedCallback _received_callback;
+    SentCallback _sent_callback;
 public:
-    Channel(EventLoop *loop, int fd):_fd(fd), _events(0), _revents(0), _loop(loop) {}
+    Channel(EventLoop *loop, int fd):_fd(fd), _events(0), _revents(0), _edge_triggered(false),
+                                     _state(ChannelState::NEW), _registered(0), _dirty(false), _io(ChannelIo::READY), _loop(loop) {}
     int Fd() { return _fd; }
-    uint32_t Events() { return _events; }
+    //注册到epoll的事件，边缘触发模式下带上EPOLLET
+    uint32_t Events() { return _edge_triggered ? (_events | EPOLLET) : _events; }
+    bool EdgeTriggered() { return _edge_triggered; }
+    bool NoneEvent() { return _events == 0; }
+    ChannelState State() { return _state; }
+    void SetState(ChannelState state) { _state = state; }
+    uint32_t Registered() { return _registered; }
+    void SetRegistered(uint32_t events) { _registered = events; }
+    bool Dirty() { return _dirty; }
+    void SetDirty(bool dirty) { _dirty = dirty; }
+    //切换触发模式，已经在监控中的会立即更新
+    void SetEdgeTriggered(bool on) {
+        _edge_triggered = on;
+        if (_events) Update();
+    }
+    uint32_t REvents() { return _revents; }
     void SetREvents(uint32_t events) { _revents = events; }
-    void SetReadCallback(const EventCallback &cb) { _read_callback = cb; }
-    void SetWriteCallback(const EventCallback &cb) { _write_callback = cb; }
-    void SetErrorCallback(const EventCallback &cb) { _error_callback = cb; }
-    void SetCloseCallback(const EventCallback &cb) { _close_callback = cb; }
-    void SetEventCallback(const EventCallback &cb) { _event_callback = cb; }
+    void SetReadCallback(EventCallback cb) { _read_callback = std::move(cb); }
+    void SetWriteCallback(EventCallback cb) { _write_callback = std::move(cb); }
+    void SetErrorCallback(EventCallback cb) { _error_callback = std::move(cb); }
+    void SetCloseCallback(EventCallback cb) { _close_callback = std::move(cb); }
+    void SetEventCallback(EventCallback cb) { _event_callback = std::move(cb); }
+    ChannelIo IoMode() { return _io; }
+    //在启动读事件监控之前设置
+    void SetIoMode(ChannelIo io) { _io = io; }
+    void SetAcceptedCallback(AcceptedCallback cb) { _accepted_callback = std::move(cb); }
+    void SetReceivedCallback(ReceivedCallback cb) { _received_callback = std::move(cb); }
+    void SetSentCallback(SentCallback cb) { _sent_callback = std::move(cb); }
     
     bool ReadAble() { return (_events & EPOLLIN); }
     
@@ -62,4 +110,17 @@ public:
         }
         if (_event_callback) _event_callback();
     }
+    //完成通知，由Poller在处理完就绪事件之后调用，之后和就绪事件一样调用任意事件回调
+    void HandleAccepted(int fd) {
+        if (_accepted_callback) _accepted_callback(fd);
+        if (_event_callback) _event_callback();
+    }
+    void HandleReceived(const char *data, ssize_t len) {
+        if (_received_callback) _received_callback(data, len);
+        if (_event_callback) _event_callback();
+    }
+    void HandleSent(ssize_t res, bool done) {
+        if (_sent_callback) _sent_callback(res, done);
+        if (_event_callback) _event_callback();
+    }
 };
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+
+#define CLOCK_LOG_TIME_SIZE 16      //"%H:%M:%S"
+#define CLOCK_HTTP_DATE_SIZE 32     //"Sun, 06 Nov 1994 08:49:37 GMT"
+
+//每个线程缓存的当前时间，EventLoop在每一轮事件等待返回之后更新一次，同一轮中的使用者都读这份缓存，不再各自读时钟
+//没有EventLoop的线程(比如主线程在Start之前)每次读取时自己更新
+//日志时间和HTTP的Date头按秒缓存格式化好的字符串，秒数变化时才重新格式化
+class LoopClock {
+private:
+    bool _driven;           //是否由EventLoop驱动更新
+    bool _coarse;           //使用CLOCK_*_COARSE，精度是一个内核节拍(1~4毫秒)，读取时不访问时钟源
+    uint64_t _mono_us;      //CLOCK_MONOTONIC，微秒
+    uint64_t _wall_us;      //CLOCK_REALTIME，微秒
+    time_t _log_sec;        //_log_time对应的秒数
+    time_t _date_sec;       //_http_date对应的秒数
+    char _log_time[CLOCK_LOG_TIME_SIZE];
+    char _http_date[CLOCK_HTTP_DATE_SIZE];
+private:
+    static uint64_t Read(clockid_t id) {
+        struct timespec ts{};
+        clock_gettime(id, &ts);
+        return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+    void Fresh() {
+        if (!_driven) Update();
+    }
+public:
+    LoopClock():_driven(false), _coarse(false), _mono_us(0), _wall_us(0),
+                _log_sec(-1), _date_sec(-1), _log_time{}, _http_date{} {
+        Update();
+    }
+    static LoopClock &Local() {
+        thread_local LoopClock clock;
+        return clock;
+    }
+    //读取一次时钟，更新缓存的时间
+    void Update() {
+        _mono_us = Read(_coarse ? CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC);
+        _wall_us = Read(_coarse ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME);
+    }
+    //由EventLoop在每一轮更新，之后读取缓存时不再读时钟
+    void SetDriven(bool driven) { _driven = driven; }
+    void SetCoarse(bool coarse) { _coarse = coarse; Update(); }
+    uint64_t MonoUs() { Fresh(); return _mono_us; }
+    uint64_t MonoMs() { Fresh(); return _mono_us / 1000; }
+    uint64_t WallMs() { Fresh(); return _wall_us / 1000; }
+    time_t WallSec() { Fresh(); return (time_t)(_wall_us / 1000000); }
+    //日志使用的本地时间 时:分:秒
+    const char *LogTime() {
+        time_t sec = WallSec();
+        if (sec != _log_sec) {
+            struct tm ltm{};
+            localtime_r(&sec, &ltm);
+            strftime(_log_time, sizeof(_log_time), "%H:%M:%S", &ltm);
+            _log_sec = sec;
+        }
+        return _log_time;
+    }
+    //HTTP的Date头，RFC 7231格式，GMT时间
+    const char *HttpDate() {
+        time_t sec = WallSec();
+        if (sec != _date_sec) {
+            struct tm gtm{};
+            gmtime_r(&sec, &gtm);
+            strftime(_http_date, sizeof(_http_date), "%a, %d %b %Y %H:%M:%S GMT", &gtm);
+            _date_sec = sec;
+        }
+        return _http_date;
+    }
+};
@@ -4,8 +4,16 @@
 #include "EventLoop.hpp"
 #include "Buffer.hpp"
 #include <any>
+#include <functional>
 #include <utility>
 
+#define CONN_READ_IOVEC 16  //链式输入缓冲区一次readv最多预留的分段个数
+#define CONN_READ_BUDGET (256 << 10)    //一次可读事件最多读取的字节数，读满后让出EventLoop，一个连接不会饿死同一线程的其他连接
+#define CONN_HIGH_WATER_MARK (64 << 20)  //输出缓冲区默认高水位
+//连接上的其他定时任务用连接ID加上高位标志作为定时器ID，避免和非活跃销毁任务冲突
+#define CONN_TIMER_SHRINK (1ULL << 62)  //空闲收缩缓冲区
+#define CONN_TIMER_RESUME (1ULL << 61)  //缓冲区配额超限后检查是否可以恢复读取
+
 enum class ConnStatu {
     DISCONNECTED,
     CONNECTING,
@@ -29,9 +37,20 @@ private:
     ConnStatu _statu;   // 连接状态
     Socket _socket;     // 套接字操作管理
     Channel _channel;   // 连接的事件管理
-    Buffer _in_buffer;  // 输入缓冲区---存放从socket中读取到的数据
-    Buffer _out_buffer; // 输出缓冲区---存放要发送给对端的数据
+    Buffer _in_buffer;  // 输入缓冲区---存放从socket中读取到的数据，默认连续模式，方便协议解析
+    Buffer _out_buffer; // 输出缓冲区---存放要发送给对端的数据，链式模式，追加大块数据时不搬移已有数据
     std::any _context;       // 请求的接收处理上下文
+    BufferShrinkPolicy _shrink_policy;      // 缓冲区收缩策略
+    std::shared_ptr<BufferQuota> _quota;    // 服务器共享的缓冲区配额，为空表示不限制
+    uint64_t _buffered_bytes;   // 当前计入配额和EventLoop负载的缓冲数据量
+    bool _quota_paused;     // 是否因为配额超限暂停了读取
+    bool _peer_paused;      // 是否因为输出缓冲区超过高水位(对端接收太慢)暂停了读取
+    bool _pause_read_on_high_water; // 输出缓冲区超过高水位时是否自动暂停读取
+    uint64_t _high_water_mark;      // 输出缓冲区高水位
+    uint64_t _last_active;          // 最近一次有事件的时间，非活跃释放和空闲收缩按它判断，不需要每次刷新定时器
+    bool _async_io;         // 由io_uring完成recv和send，不再使用可读可写事件
+    bool _sending;          // io_uring的发送还没有结束，输出缓冲区中已经提交的数据不能移动
+    bool _flush_pending;    // 已经投递了提交发送的任务
 
     /*这四个回调函数，是让服务器模块来设置的（其实服务器模块的处理回调也是组件使用者设置的）*/
     /*换句话说，这几个回调都是组件使用者使用的*/
@@ -39,47 +58,162 @@ private:
     using MessageCallback = std::function<void(const PtrConnection&, Buffer *)>;
     using ClosedCallback = std::function<void(const PtrConnection&)>;
     using AnyEventCallback = std::function<void(const PtrConnection&)>;
+    using HighWaterMarkCallback = std::function<void(const PtrConnection&, size_t)>;
+    using WriteCompleteCallback = std::function<void(const PtrConnection&)>;
     ConnectedCallback _connected_callback;
     MessageCallback _message_callback;
     ClosedCallback _closed_callback;
     AnyEventCallback _event_callback;
+    HighWaterMarkCallback _high_water_mark_callback;  // 输出缓冲区涨过高水位时调用
+    WriteCompleteCallback _write_complete_callback;   // 输出缓冲区中的数据全部发送完时调用
     /*组件内的连接关闭回调--组件内设置的，因为服务器组件内会把所有的连接管理起来，一旦某个连接要关闭*/
     /*就应该从管理的地方移除掉自己的信息*/
     ClosedCallback _server_closed_callback;
 private:
+    //直接把socket数据读到输入缓冲区尾部，放不下的部分先落到栈上的额外缓冲区再追加进去
+    //返回读到的长度，出错返回-1；*more表示本次读满了提供的全部空间，内核中可能还有数据
+    ssize_t RecvToBuffer(bool *more) {
+        char extrabuf[65536];
+        struct iovec iov[CONN_READ_IOVEC + 1];
+        int cnt = _in_buffer.ReserveWriteVecs(iov, CONN_READ_IOVEC);
+        uint64_t writable = 0;
+        for (int i = 0; i < cnt; i++) writable += iov[i].iov_len;
+        iov[cnt].iov_base = extrabuf;
+        iov[cnt].iov_len = sizeof(extrabuf);
+        ssize_t ret = _socket.NonBlockRecvv(iov, cnt + 1);
+        if (ret < 0) {
+            _in_buffer.CommitWriteVecs(0);
+            return -1;
+        }
+        if ((uint64_t)ret <= writable) {
+            _in_buffer.CommitWriteVecs(ret);
+        }else {
+            _in_buffer.CommitWriteVecs(writable);
+            _in_buffer.WriteAndPush(extrabuf, ret - writable);
+        }
+        *more = ((uint64_t)ret == writable + sizeof(extrabuf));
+        return ret;
+    }
     /*五个channel的事件回调函数*/
     //描述符可读事件触发后调用的函数，接收socket数据放到接收缓冲区中，然后调用_message_callback
     void HandleRead() {
-        //1. 接收socket的数据，放到缓冲区
-        char buf[65536];
-        ssize_t ret = _socket.NonBlockRecv(buf, 65535);
-        if (ret < 0) {
-            //出错了,不能直接关闭连接
-            return ShutdownInLoop();
-        }
+        //1. 接收socket的数据，放到缓冲区，读满了就继续读，直到内核接收缓冲区被读空
         //这里的等于0表示的是没有读取到数据，而并不是连接断开了，连接断开返回的是-1
-        //将数据放入输入缓冲区,写入之后顺便将写偏移向后移动
-        _in_buffer.WriteAndPush(buf, ret);
+        //边缘触发模式下要一直读到EAGAIN，否则和数据一起到达的连接关闭不会再有通知
+        //每次最多读取CONN_READ_BUDGET字节，读完先交给使用者处理，配额和对端速度的暂停判断也能及时生效
+        bool more = true;
+        bool drained = false;
+        uint64_t budget = CONN_READ_BUDGET;
+        while (true) {
+            ssize_t ret = RecvToBuffer(&more);
+            if (ret < 0) {
+                //出错了,不能直接关闭连接
+                return ShutdownInLoop();
+            }
+            if (ret == 0 || (!more && !_channel.EdgeTriggered())) {
+                drained = true;
+                break;
+            }
+            if ((uint64_t)ret >= budget) break;
+            budget -= ret;
+        }
         //2. 调用message_callback进行业务处理
         if (_in_buffer.ReadableSize() > 0) {
             //shared_from_this--从当前对象自身获取自身的shared_ptr管理对象
-            return _message_callback(shared_from_this(), &_in_buffer);
+            _message_callback(shared_from_this(), &_in_buffer);
         }
+        BuffersChanged();
+        CheckBackpressure();
+        //读满了额度，内核中可能还有数据。水平触发下epoll会再次通知，边缘触发不会，放到任务池中继续读取
+        if (!drained && _channel.EdgeTriggered()) ContinueRead();
     }
-    //描述符可写事件触发后调用的函数，将发送缓冲区中的数据进行发送
-    void HandleWrite() {
-        //_out_buffer中保存的数据就是要发送的数据
-        ssize_t ret = _socket.NonBlockSend(_out_buffer.ReadPosition(), _out_buffer.ReadableSize());
-        if (ret < 0) {
-            //发送错误就该关闭连接了，
+    //暂停了读取或者连接已经关闭时不再继续，恢复读取时重新监控会再次通知
+    void ContinueRead() {
+        PtrConnection self = shared_from_this();
+        _loop->QueueInLoop([self] {
+            if (self->_statu != ConnStatu::CONNECTED || !self->_channel.ReadAble()) return;
+            self->HandleRead();
+        });
+    }
+    //io_uring完成的recv：数据还在接收缓冲区环中，追加到输入缓冲区之后和HandleRead一样处理，回调返回后缓冲区还给内核
+    //读到结尾或者出错时recv请求已经结束，不会再有数据
+    void HandleReceived(const char *data, ssize_t len) {
+        if (len <= 0) {
+            if (len < 0) ERR_LOG("SOCKET RECV FAILED:%s", strerror(-len));
+            return ShutdownInLoop();
+        }
+        _in_buffer.WriteAndPush(data, len);
+        _message_callback(shared_from_this(), &_in_buffer);
+        BuffersChanged();
+        CheckBackpressure();
+    }
+    //一轮中的多次发送合并成一个请求，在本轮的任务中提交，和下一次等待一起交给内核
+    void ScheduleFlush() {
+        if (_flush_pending || _sending) return ;
+        _flush_pending = true;
+        PtrConnection self = shared_from_this();
+        _loop->QueueInLoop([self] {
+            self->_flush_pending = false;
+            self->FlushInLoop();
+        });
+    }
+    //把输出缓冲区中的数据提交给io_uring发送，发送结束之前连接一直被请求持有，已经提交的分段不会被释放或者移动
+    void FlushInLoop() {
+        if (_sending || _statu == ConnStatu::DISCONNECTED || _out_buffer.ReadableSize() == 0) return ;
+        struct iovec iov[BUFFER_MAX_IOVEC];
+        int cnt = _out_buffer.ReadVecs(iov, BUFFER_MAX_IOVEC);
+        _sending = true;
+        _loop->SubmitSend(&_channel, iov, cnt, shared_from_this());
+    }
+    //io_uring完成的发送：每发出一部分就释放这部分分段，全部结束后和HandleWrite一样处理，还有新数据就继续发送
+    void HandleSent(ssize_t res, bool done) {
+        if (res > 0) _out_buffer.MoveReadOffset(res);
+        if (!done) return ;
+        _sending = false;
+        if (res < 0) {
+            ERR_LOG("SOCKET SEND FAILED:%s", strerror(-res));
             if (_in_buffer.ReadableSize() > 0) {
                 _message_callback(shared_from_this(), &_in_buffer);
             }
-            return Release();//这时候就是实际的关闭释放操作了。
+            return Release();
+        }
+        WriteProgress();
+        FlushInLoop();
+    }
+    //描述符可写事件触发后调用的函数，将发送缓冲区中的数据进行发送
+    void HandleWrite() {
+        //_out_buffer中保存的数据就是要发送的数据，一次writev发送所有分段
+        //全部发出去了还有剩余(分段超过iovec上限)就继续发送，发不完说明内核发送缓冲区满了，等下次可写事件
+        struct iovec iov[BUFFER_MAX_IOVEC];
+        while (_out_buffer.ReadableSize() > 0) {
+            int cnt = _out_buffer.ReadVecs(iov, BUFFER_MAX_IOVEC);
+            size_t total = 0;
+            for (int i = 0; i < cnt; i++) total += iov[i].iov_len;
+            ssize_t ret = _socket.NonBlockSendv(iov, cnt);
+            if (ret < 0) {
+                //发送错误就该关闭连接了，
+                if (_in_buffer.ReadableSize() > 0) {
+                    _message_callback(shared_from_this(), &_in_buffer);
+                }
+                return Release();//这时候就是实际的关闭释放操作了。
+            }
+            _out_buffer.MoveReadOffset(ret);//千万不要忘了，将读偏移向后移动
+            if ((size_t)ret < total) break;
+        }
+        WriteProgress();
+    }
+    //输出缓冲区中的数据发出去之后：更新配额，恢复因为配额或者对端太慢暂停的读取，全部发完时通知使用者
+    void WriteProgress() {
+        BuffersChanged();
+        if (_quota_paused && _quota->Recovered()) ResumeReadInLoop();
+        //对端跟上了，输出缓冲区降到高水位一半以下，恢复读取
+        if (_peer_paused && _out_buffer.ReadableSize() <= _high_water_mark / 2) {
+            _peer_paused = false;
+            UpdateReadInterest();
         }
-        _out_buffer.MoveReadOffset(ret);//千万不要忘了，将读偏移向后移动
         if (_out_buffer.ReadableSize() == 0) {
-            _channel.DisableWrite();// 没有数据待发送了，关闭写事件监控
+            if (_channel.WriteAble()) _channel.DisableWrite();// 没有数据待发送了，关闭写事件监控
+            WriteComplete();
             //如果当前是连接待关闭状态，则有数据，发送完数据释放连接，没有数据则直接释放
             if (_statu == ConnStatu::DISCONNECTING) {
                 return Release();
@@ -98,9 +232,9 @@ private:
     void HandleError() {
         return HandleClose();
     }
-    //描述符触发任意事件: 1. 刷新连接的活跃度--延迟定时销毁任务；  2. 调用组件使用者的任意事件回调
+    //描述符触发任意事件: 1. 记录连接的活跃时间，定时任务到期时检查；  2. 调用组件使用者的任意事件回调
     void HandleEvent() {
-        if (_enable_inactive_release)  {  _loop->TimerRefresh(_conn_id); }
+        _last_active = _loop->PollTimeMs();
         if (_event_callback)  {  _event_callback(shared_from_this()); }
     }
     //连接获取之后，所处的状态下要进行各种设置（启动读监控,调用回调函数）
@@ -108,6 +242,8 @@ private:
         // 1. 修改连接状态；  2. 启动读事件监控；  3. 调用回调函数
         assert(_statu == ConnStatu::CONNECTING);//当前的状态必须一定是上层的半连接状态
         _statu = ConnStatu::CONNECTED;//当前函数执行完毕，则连接进入已完成连接状态
+        //缓存的时间属于所属线程，只能在这里读取，构造函数可能运行在其他线程
+        _last_active = _loop->PollTimeMs();
         // 一旦启动读事件监控就有可能会立即触发读事件，如果这时候启动了非活跃连接销毁
         _channel.EnableRead();
         if (_connected_callback) _connected_callback(shared_from_this());
@@ -122,15 +258,41 @@ private:
         _socket.Close();
         //4. 如果当前定时器队列中还有定时销毁任务，则取消任务
         if (_loop->HasTimer(_conn_id)) CancelInactiveReleaseInLoop();
+        //归还占用的缓冲区配额
+        if (_quota) _quota->Add(-(int64_t)_buffered_bytes);
+        _loop->Stats().pending_bytes.fetch_sub(_buffered_bytes, std::memory_order_relaxed);
+        _buffered_bytes = 0;
         //5. 调用关闭回调函数，避免先移除服务器管理的连接信息导致Connection被释放，再去处理会出错，因此先调用用户的回调函数
         if (_closed_callback) _closed_callback(shared_from_this());
         //移除服务器内部管理的连接信息
         if (_server_closed_callback) _server_closed_callback(shared_from_this());
     }
     //这个接口并不是实际的发送接口，而只是把数据放到了发送缓冲区，启动了可写事件监控
+    //输出缓冲区中没有待发送的数据时先直接发送，只有发不完的部分才放进输出缓冲区并启动可写事件监控
+    //剩余数据的所有权转移到输出缓冲区，大块数据直接挂到链上，不拷贝
     void SendInLoop(Buffer &buf) {
         if (_statu == ConnStatu::DISCONNECTED) return ;
-        _out_buffer.WriteBufferAndPush(buf);
+        if (!_async_io && _out_buffer.ReadableSize() == 0 && !_channel.WriteAble()) {
+            struct iovec iov[BUFFER_MAX_IOVEC];
+            int cnt = buf.ReadVecs(iov, BUFFER_MAX_IOVEC);
+            ssize_t ret = _socket.NonBlockSendv(iov, cnt);
+            //发送出错时数据照常放进输出缓冲区，由可写事件中的HandleWrite处理错误并释放连接
+            //这里不能调用消息回调：Send通常就是在消息回调中调用的，出错时会无限递归
+            if (ret >= 0) {
+                buf.MoveReadOffset(ret);
+                _loop->Stats().direct_sends.fetch_add(1, std::memory_order_relaxed);
+                _loop->Stats().direct_send_bytes.fetch_add(ret, std::memory_order_relaxed);
+                //全部发送完成，不需要启动可写事件监控
+                //待关闭状态下输出缓冲区为空，说明释放操作已经由ShutdownInLoop或者HandleWrite发起了
+                if (buf.ReadableSize() == 0) return WriteComplete();
+            }
+        }
+        _loop->Stats().queued_sends.fetch_add(1, std::memory_order_relaxed);
+        uint64_t old_len = _out_buffer.ReadableSize();
+        _out_buffer.WriteBufferAndPush(std::move(buf));
+        BuffersChanged();
+        CheckHighWaterMark(old_len);
+        if (_async_io) return ScheduleFlush();
         if (!_channel.WriteAble()) {
             _channel.EnableWrite();
         }
@@ -140,10 +302,13 @@ private:
         _statu = ConnStatu::DISCONNECTING;// 设置连接为半关闭状态
         if (_in_buffer.ReadableSize() > 0) {
             if (_message_callback) _message_callback(shared_from_this(), &_in_buffer);
+            BuffersChanged();
         }
         //要么就是写入数据的时候出错关闭，要么就是没有待发送数据，直接关闭
         if (_out_buffer.ReadableSize() > 0) {
-            if (!_channel.WriteAble()) {
+            if (_async_io) {
+                FlushInLoop();
+            }else if (!_channel.WriteAble()) {
                 _channel.EnableWrite();
             }
         }
@@ -151,16 +316,107 @@ private:
             Release();
         }
     }
+    //缓冲区数据量变化之后调用：更新服务器的缓冲区配额和EventLoop的负载，按照收缩策略释放缓冲区多余的空间
+    void BuffersChanged() {
+        uint64_t bytes = _in_buffer.ReadableSize() + _out_buffer.ReadableSize();
+        if (bytes != _buffered_bytes) {
+            int64_t delta = (int64_t)bytes - (int64_t)_buffered_bytes;
+            if (_quota) _quota->Add(delta);
+            _loop->Stats().pending_bytes.fetch_add(delta, std::memory_order_relaxed);
+            _buffered_bytes = bytes;
+        }
+        if (_shrink_policy.max_capacity == 0) return;
+        for (Buffer *buf : {&_in_buffer, &_out_buffer}) {
+            //正在发送的分段不能移动
+            if (buf == &_out_buffer && _sending) continue;
+            if (buf->ReadableSize() <= _shrink_policy.drain_threshold && buf->Capacity() > _shrink_policy.max_capacity) {
+                buf->Shrink();
+            }
+        }
+        //还有缓冲区超过容量上限，启动空闲收缩任务，连接有活动时会被刷新延迟
+        if (_shrink_policy.idle_seconds == 0 || _loop->HasTimer(_conn_id | CONN_TIMER_SHRINK)) return;
+        if (_in_buffer.Capacity() > _shrink_policy.max_capacity || _out_buffer.Capacity() > _shrink_policy.max_capacity) {
+            ScheduleShrink(IdleShrinkMs());
+        }
+    }
+    uint64_t IdleShrinkMs() { return (uint64_t)_shrink_policy.idle_seconds * 1000; }
+    //连接可能比定时任务先释放，任务只持有weak_ptr，到期时再按_last_active判断是否真的空闲
+    void ScheduleShrink(uint64_t delay_ms) {
+        std::weak_ptr<Connection> weak = shared_from_this();
+        _loop->TimerAdd(_conn_id | CONN_TIMER_SHRINK, std::chrono::milliseconds(delay_ms), [weak] {
+            if (auto conn = weak.lock()) conn->ShrinkBuffersInLoop();
+        });
+    }
+    void ShrinkBuffersInLoop() {
+        uint64_t timeout = IdleShrinkMs();
+        uint64_t idle = _loop->PollTimeMs() - _last_active;
+        if (idle < timeout) return ScheduleShrink(timeout - idle);
+        _in_buffer.Shrink();
+        if (!_sending) _out_buffer.Shrink();
+    }
+    //服务器缓冲数据总量超过配额，暂停读取，直到配额降到低水位以下
+    void CheckBackpressure() {
+        if (!_quota || _quota_paused || _statu != ConnStatu::CONNECTED) return;
+        if (!_quota->Exceeded()) return;
+        _quota_paused = true;
+        UpdateReadInterest();
+        ScheduleResumeRead();
+    }
+    //读取暂停期间没有读事件，只能定时检查配额
+    void ScheduleResumeRead() {
+        uint64_t timer_id = _conn_id | CONN_TIMER_RESUME;
+        if (_loop->HasTimer(timer_id)) return;
+        std::weak_ptr<Connection> weak = shared_from_this();
+        _loop->TimerAdd(timer_id, std::chrono::seconds(1), [weak] {
+            //定时任务执行之前已经从定时器中移除，这里可以直接添加同ID的定时任务
+            if (auto conn = weak.lock()) conn->ResumeReadInLoop();
+        });
+    }
+    void ResumeReadInLoop() {
+        if (!_quota_paused || _statu != ConnStatu::CONNECTED) return;
+        if (!_quota->Recovered()) return ScheduleResumeRead();
+        _quota_paused = false;
+        UpdateReadInterest();
+    }
+    //根据暂停标志调整读事件监控，配额和对端速度两个暂停原因都解除了才恢复读取
+    void UpdateReadInterest() {
+        if (_statu != ConnStatu::CONNECTED) return;
+        bool paused = _quota_paused || _peer_paused;
+        if (paused && _channel.ReadAble()) {
+            _channel.DisableRead();
+        }else if (!paused && !_channel.ReadAble()) {
+            _channel.EnableRead();
+        }
+    }
+    //输出缓冲区从高水位以下涨到高水位以上时通知使用者，需要时暂停读取，避免慢速对端导致内存无限增长
+    void CheckHighWaterMark(uint64_t old_len) {
+        uint64_t len = _out_buffer.ReadableSize();
+        if (old_len >= _high_water_mark || len < _high_water_mark) return;
+        if (_high_water_mark_callback) {
+            //放到任务池中执行，避免在使用者的Send调用中重入
+            PtrConnection self = shared_from_this();
+            _loop->QueueInLoop([self, len] { self->_high_water_mark_callback(self, len); });
+        }
+        if (_pause_read_on_high_water) {
+            _peer_paused = true;
+            UpdateReadInterest();
+        }
+    }
+    //输出缓冲区中的数据全部发送完毕
+    void WriteComplete() {
+        if (!_write_complete_callback) return;
+        PtrConnection self = shared_from_this();
+        _loop->QueueInLoop([self] { self->_write_complete_callback(self); });
+    }
     //启动非活跃连接超时释放规则
-    void EnableInactiveReleaseInLoop(int sec) {
+    void EnableInactiveReleaseInLoop(TimerDuration timeout) {
         //1. 将判断标志 _enable_inactive_release 置为true
         _enable_inactive_release = true;
-        //2. 如果当前定时销毁任务已经存在，那就刷新延迟一下即可
-        if (_loop->HasTimer(_conn_id)) {
-            return _loop->TimerRefresh(_conn_id);
-        }
+        //2. 从现在开始计算非活跃时间，如果当前定时销毁任务已经存在，到期时会按活跃时间重新计算
+        _last_active = _loop->PollTimeMs();
+        if (_loop->HasTimer(_conn_id)) return;
         //3. 如果不存在定时销毁任务，则新增
-        _loop->TimerAdd(_conn_id, sec, [this] { Release(); });
+        _loop->TimerAddIdle(_conn_id, timeout, &_last_active, [this] { Release(); });
     }
     void CancelInactiveReleaseInLoop() {
         _enable_inactive_release = false;
@@ -180,16 +436,31 @@ private:
         _event_callback = event;
     }
 public:
-    Connection(EventLoop *loop, uint64_t conn_id, int sockfd):_conn_id(conn_id), _sockfd(sockfd),
+    Connection(EventLoop *loop, uint64_t conn_id, int sockfd, BufferMode in_mode = BufferMode::CONTIGUOUS):
+                                                              _conn_id(conn_id), _sockfd(sockfd),
                                                               _enable_inactive_release(false), _loop(loop), _statu(ConnStatu::CONNECTING), _socket(_sockfd),
-                                                              _channel(loop, _sockfd) {
+                                                              _channel(loop, _sockfd), _in_buffer(in_mode), _out_buffer(BufferMode::CHAINED),
+                                                              _buffered_bytes(0), _quota_paused(false), _peer_paused(false),
+                                                              _pause_read_on_high_water(false), _high_water_mark(CONN_HIGH_WATER_MARK),
+                                                              _last_active(0), _async_io(loop->AsyncIo()),
+                                                              _sending(false), _flush_pending(false) {
         _channel.SetCloseCallback([this] { HandleClose(); });
         _channel.SetEventCallback([this] { HandleEvent(); });
         _channel.SetReadCallback([this] { HandleRead(); });
         _channel.SetWriteCallback([this] { HandleWrite(); });
         _channel.SetErrorCallback([this] { HandleError(); });
+        if (_async_io) {
+            _channel.SetIoMode(ChannelIo::RECV);
+            _channel.SetReceivedCallback([this](const char *data, ssize_t len) { HandleReceived(data, len); });
+            _channel.SetSentCallback([this](ssize_t res, bool done) { HandleSent(res, done); });
+        }
+        //构造时就计入连接数，连接风暴时还没有就绪的连接也能参与负载均衡
+        _loop->Stats().connections.fetch_add(1, std::memory_order_relaxed);
+    }
+    ~Connection() {
+        _loop->Stats().connections.fetch_sub(1, std::memory_order_relaxed);
+        DBG_LOG("RELEASE CONNECTION:%p", this);
     }
-    ~Connection() { DBG_LOG("RELEASE CONNECTION:%p", this); }
     //获取管理的文件描述符
     int Fd() { return _sockfd; }
     //获取连接ID
@@ -205,6 +476,21 @@ public:
     void SetClosedCallback(const ClosedCallback&cb) { _closed_callback = cb; }
     void SetAnyEventCallback(const AnyEventCallback&cb) { _event_callback = cb; }
     void SetSrvClosedCallback(const ClosedCallback&cb) { _server_closed_callback = cb; }
+    //输出缓冲区涨过mark字节时调用cb
+    void SetHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t mark) {
+        _high_water_mark_callback = cb;
+        _high_water_mark = mark;
+    }
+    void SetWriteCompleteCallback(const WriteCompleteCallback &cb) { _write_complete_callback = cb; }
+    //输出缓冲区超过高水位时暂停读取，降到高水位一半以下时恢复
+    void SetPauseReadOnHighWater(bool on) { _pause_read_on_high_water = on; }
+    //以下几个设置在连接建立之前调用
+    void SetShrinkPolicy(const BufferShrinkPolicy &policy) { _shrink_policy = policy; }
+    void SetBufferQuota(const std::shared_ptr<BufferQuota> &quota) { _quota = quota; }
+    //使用边缘触发模式监控连接，读写都会一直处理到EAGAIN为止；由io_uring完成读写时不起作用
+    void SetEdgeTriggered(bool on) { _channel.SetEdgeTriggered(on); }
+    //设置套接字的SO_BUSY_POLL，返回是否设置成功
+    bool SetBusyPoll(int usec) { return _socket.BusyPoll(usec); }
     //连接建立就绪后，进行channel回调设置，启动读监控，调用_connected_callback
     void Established() {
         _loop->RunInLoop([this] { EstablishedInLoop(); });
@@ -212,10 +498,30 @@ public:
     //发送数据，将数据放到发送缓冲区，启动写事件监控
     void Send(const char *data, size_t len) {
         //外界传入的data，可能是个临时的空间，我们现在只是把发送操作压入了任务池，有可能并没有被立即执行
-        //因此有可能执行的时候，data指向的空间有可能已经被释放了。
+        //因此有可能执行的时候，data指向的空间有可能已经被释放了，所以这里拷贝一次，之后只转移所有权。
         Buffer buf;
         buf.WriteAndPush(data, len);
-        _loop->RunInLoop([this, &buf] { SendInLoop(buf); });
+        Send(std::move(buf));
+    }
+    //以下几个接口转移数据的所有权，数据直接从这些内存块发送，不再拷贝
+    void Send(std::string &&data) {
+        Buffer buf(BufferMode::CHAINED);
+        buf.WriteStringAndPush(std::move(data));
+        Send(std::move(buf));
+    }
+    //发送共享的数据片，多个连接可以同时发送同一个Slice
+    void Send(const Slice &slice) {
+        Buffer buf(BufferMode::CHAINED);
+        buf.WriteSliceAndPush(slice);
+        Send(std::move(buf));
+    }
+    void Send(Buffer &&buf) {
+        if (_loop->IsInLoop()) {
+            return SendInLoop(buf);
+        }
+        //跨线程时数据随任务一起转移到EventLoop线程，不能引用调用者栈上的对象
+        auto ptr = std::make_shared<Buffer>(std::move(buf));
+        _loop->QueueInLoop([this, ptr] { SendInLoop(*ptr); });
     }
     //提供给组件使用者的关闭接口--并不实际关闭，需要判断有没有数据待处理
     void Shutdown() {
@@ -225,8 +531,8 @@ public:
         _loop->QueueInLoop([this] { ReleaseInLoop(); });
     }
     //启动非活跃销毁，并定义多长时间无通信就是非活跃，添加定时任务
-    void EnableInactiveRelease(int sec) {
-        _loop->RunInLoop([this, sec] { EnableInactiveReleaseInLoop(sec); });
+    void EnableInactiveRelease(TimerDuration timeout) {
+        _loop->RunInLoop([this, timeout] { EnableInactiveReleaseInLoop(timeout); });
     }
     //取消非活跃销毁
     void CancelInactiveRelease() {
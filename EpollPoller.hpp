@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Poller.hpp"
+#include <cstring>
+#include <sys/epoll.h>
+
+#define MAX_EPOLLEVENTS 4096        //就绪事件数组的上限
+#define INIT_EPOLLEVENTS 16         //就绪事件数组的初始大小
+#define SHRINK_EPOLLROUNDS 64       //连续这么多轮就绪事件不到数组的1/4，数组缩小一半
+
+class EpollPoller : public Poller {
+private:
+    int _epfd;
+    std::vector<struct epoll_event> _evs;   //就绪事件数组，填满时加倍，长时间用不到时减半
+    int _idle_rounds;                       //连续就绪事件不到数组1/4的轮数
+private:
+    //对epoll的直接操作，epoll_event中直接保存Channel指针，就绪时不需要再查找
+    void Update(Channel *channel, int op, uint32_t events) {
+        // int epoll_ctl(int epfd, int op,  int fd,  struct epoll_event *ev);
+        int fd = channel->Fd();
+        struct epoll_event ev{};
+        ev.data.ptr = channel;
+        ev.events = events;
+        Add(_stats.ctl_calls, 1);
+        int ret = epoll_ctl(_epfd, op, fd, &ev);
+        if (ret < 0) {
+            ERR_LOG("EPOLLCTL FAILED!");
+        }
+    }
+    //把Channel最终的监控事件和内核中注册的事件比较，只有变化了才调用epoll_ctl
+    //没有任何监控事件时以空事件留在epoll中，内核总是会通知EPOLLHUP和EPOLLERR，暂停读取的连接被挂断时也能及时关闭
+    void ApplyChange(Channel *channel) override {
+        channel->SetDirty(false);
+        uint32_t events = channel->NoneEvent() ? 0 : channel->Events();
+        if (events == channel->Registered()) {
+            Add(_stats.skipped_updates, 1);
+            return ;
+        }
+        if (channel->State() != ChannelState::ADDED) {
+            channel->SetState(ChannelState::ADDED);
+            Update(channel, EPOLL_CTL_ADD, events);
+        }else {
+            Update(channel, EPOLL_CTL_MOD, events);
+        }
+        channel->SetRegistered(events);
+    }
+    //根据本轮就绪事件的个数调整数组大小
+    void Resize(int nfds) {
+        int size = (int)_evs.size();
+        if (nfds == size && size < MAX_EPOLLEVENTS) {
+            _evs.resize(std::min(size * 2, MAX_EPOLLEVENTS));
+            _idle_rounds = 0;
+        }else if (nfds < size / 4 && size > INIT_EPOLLEVENTS) {
+            if (++_idle_rounds < SHRINK_EPOLLROUNDS) return ;
+            _evs.resize(size / 2);
+            _evs.shrink_to_fit();
+            _idle_rounds = 0;
+        }else {
+            _idle_rounds = 0;
+            return ;
+        }
+        _stats.events_capacity.store(_evs.size(), std::memory_order_relaxed);
+    }
+public:
+    EpollPoller():_evs(INIT_EPOLLEVENTS), _idle_rounds(0) {
+        _stats.events_capacity.store(_evs.size(), std::memory_order_relaxed);
+        _epfd = epoll_create(MAX_EPOLLEVENTS);
+        if (_epfd < 0) {
+            ERR_LOG("EPOLL CREATE FAILED!!");
+            abort();//退出程序
+        }
+    }
+    //移除监控，立即生效
+    void RemoveEvent(Channel *channel) override {
+        Forget(channel);
+        if (channel->State() == ChannelState::ADDED) {
+            Update(channel, EPOLL_CTL_DEL, 0);
+        }
+        channel->SetState(ChannelState::NEW);
+        channel->SetRegistered(0);
+    }
+    void Poll(std::vector<Channel*> *active, bool block) override {
+        //先提交上一轮积累的监控事件修改
+        ApplyChanges();
+        // int epoll_wait(int epfd, struct epoll_event *evs, int maxevents, int timeout)
+        Add(_stats.wait_calls, 1);
+        int nfds = epoll_wait(_epfd, _evs.data(), (int)_evs.size(), block ? -1 : 0);
+        if (nfds < 0) {
+            if (errno == EINTR) {
+                return ;
+            }
+            ERR_LOG("EPOLL WAIT ERROR:%s\n", strerror(errno));
+            abort();//退出程序
+        }
+        for (int i = 0; i < nfds; i++) {
+            Channel *channel = static_cast<Channel *>(_evs[i].data.ptr);
+            assert(HasChannel(channel));
+            channel->SetREvents(_evs[i].events);//设置实际就绪的事件
+            active->push_back(channel);
+        }
+        Resize(nfds);
+    }
+    const char *Name() const override { return "epoll"; }
+};
@@ -1,39 +1,76 @@
 #pragma once
 
-#include "Poller.hpp"
+#include "EpollPoller.hpp"
+#include "UringPoller.hpp"
 #include "TimeWheel.hpp"
+#include "TimerHeap.hpp"
+#include "MemoryPool.hpp"
+#include "MpscQueue.hpp"
 #include <sys/eventfd.h>
-#include <functional>
-#include <mutex>
 #include <thread>
 #include <memory>
+#include <atomic>
+#include <chrono>
 
 // eventfd(unsigned int init, int flags)
 //  flag: EFD_CLOEXEC EFD_NONBLOCK
 // read&&write should be 8 bytes
 // 唤醒阻塞
 
+#define HISTOGRAM_BUCKETS 24     //直方图的桶数，最后一个桶统计所有更大的值
+
+//按2的幂分桶的直方图：第0个桶统计0，第i个桶统计[2^(i-1), 2^i)范围内的值
+//只有所属线程记录，其他线程可以随时读取
+struct Histogram {
+    std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS]{};
+    static int Bucket(uint64_t val) {
+        if (val == 0) return 0;
+        int idx = 64 - __builtin_clzll(val);
+        return idx < HISTOGRAM_BUCKETS ? idx : HISTOGRAM_BUCKETS - 1;
+    }
+    void Record(uint64_t val) {
+        auto &bucket = buckets[Bucket(val)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    uint64_t Count(int idx) const { return buckets[idx].load(std::memory_order_relaxed); }
+};
+
+//EventLoop的运行统计，所属线程更新，其他线程可以随时读取
+struct LoopStats {
+    std::atomic<uint64_t> direct_sends{0};      //输出缓冲区为空时直接发送的次数，io_uring完成发送时没有直接发送
+    std::atomic<uint64_t> direct_send_bytes{0}; //直接发送出去的字节数
+    std::atomic<uint64_t> queued_sends{0};      //需要放进输出缓冲区等待可写事件的发送次数
+    std::atomic<uint64_t> wakeups{0};           //投递任务时写eventfd唤醒的次数
+    std::atomic<uint64_t> spin_hits{0};         //自旋轮询期间等到了就绪事件的次数
+    std::atomic<uint64_t> spin_misses{0};       //自旋时间用完还没有事件，进入阻塞等待的次数
+    //负载指标，LoopThreadPool按照这些指标为新连接选择EventLoop
+    std::atomic<int64_t> connections{0};        //分配到这个EventLoop上还没有释放的连接数
+    std::atomic<int64_t> pending_bytes{0};      //这些连接输入输出缓冲区中的数据总量
+    //每一轮循环的分布
+    Histogram events_per_wakeup;                //每次epoll_wait返回的就绪事件个数，io_uring包括I/O完成事件
+    Histogram poll_us;                          //等待就绪事件的时间，包括自旋，微秒
+    Histogram handle_us;                        //处理就绪事件和执行任务池的时间，微秒
+};
+
 class EventLoop {
 private:
-    using Functor = std::function<void()>;
+    using Functor = UniqueFunction<void()>;
     std::thread::id _thread_id;//线程ID
     int _event_fd;//eventfd唤醒IO事件监控有可能导致的阻塞
     std::unique_ptr<Channel> _event_channel;
-    Poller _poller;//进行所有描述符的事件监控
-    std::vector<Functor> _tasks;//任务池
-    std::mutex _mutex;//实现任务池操作的线程安全
-    TimerWheel _timer_wheel;//定时器模块
+    std::unique_ptr<Poller> _poller;//进行所有描述符的事件监控
+    MpscQueue<Functor> _tasks;//任务池，无锁队列，任意线程都可以投递
+    bool _handling_events;//是否正在处理就绪事件，处理完之后一定会执行任务池，不需要唤醒
+    std::unique_ptr<TimerQueue> _timer_queue;//定时器模块
+    MemoryPool *_mem_pool;//当前线程的内存池，缓冲区和连接对象都从这里申请
+    LoopStats _stats;//运行统计
+    std::vector<Channel *> _actives;//每一轮的就绪Channel，循环复用，不用每一轮重新申请
+    uint32_t _busy_poll_us;//进入阻塞等待之前自旋轮询的时间，0表示直接阻塞
+    LoopClock *_clock;//当前线程缓存的时间，每一轮等待返回之后更新一次
 public:
     //执行任务池中的所有任务
     void RunAllTask() {
-        std::vector<Functor> functor;
-        {
-            std::unique_lock<std::mutex> _lock(_mutex);
-            _tasks.swap(functor);
-        }
-        for (auto &f : functor) {
-            f();
-        }
+        _tasks.ConsumeAll([](Functor &f) { f(); });
     }
     static int CreateEventFd() {
         int efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
@@ -66,28 +103,75 @@ public:
             abort();
         }
     }
+    //创建指定类型的Poller，io_uring不可用时退回epoll
+    static std::unique_ptr<Poller> CreatePoller(PollerType type) {
+        if (type == PollerType::URING) {
+            auto poller = std::make_unique<UringPoller>();
+            if (poller->Ok()) return poller;
+            DBG_LOG("IO_URING UNAVAILABLE, FALL BACK TO EPOLL");
+        }
+        return std::make_unique<EpollPoller>();
+    }
+    std::unique_ptr<TimerQueue> CreateTimerQueue(TimerType type) {
+        if (type == TimerType::HEAP) return std::make_unique<TimerHeap>(this);
+        return std::make_unique<TimerWheel>(this);
+    }
 public:
-    EventLoop():_thread_id(std::this_thread::get_id()),
+    explicit EventLoop(PollerType type = PollerType::EPOLL, TimerType timer = TimerType::WHEEL):_thread_id(std::this_thread::get_id()),
                 _event_fd(CreateEventFd()),
                 _event_channel(std::make_unique<Channel>(this, _event_fd)),
-                _timer_wheel(this) {
+                _poller(CreatePoller(type)),
+                _handling_events(false),
+                _timer_queue(CreateTimerQueue(timer)),
+                _mem_pool(&MemoryPool::Local()),
+                _busy_poll_us(0),
+                _clock(&LoopClock::Local()) {
         //给eventfd添加可读事件回调函数，读取eventfd事件通知次数
         _event_channel->SetReadCallback([this] { ReadEventfd(); });
         //启动eventfd的读事件监控
         _event_channel->EnableRead();
     }
+    //等待就绪事件：设置了自旋时间时先不阻塞地反复检查，时间内等到了事件就省掉一次睡眠和唤醒
+    void Wait() {
+        using Clock = std::chrono::steady_clock;
+        if (_busy_poll_us > 0) {
+            auto deadline = Clock::now() + std::chrono::microseconds(_busy_poll_us);
+            do {
+                _poller->Poll(&_actives, false);
+                if (!_actives.empty() || _poller->HasCompletions()) {
+                    _stats.spin_hits.fetch_add(1, std::memory_order_relaxed);
+                    return ;
+                }
+            } while (Clock::now() < deadline);
+            _stats.spin_misses.fetch_add(1, std::memory_order_relaxed);
+        }
+        _poller->Poll(&_actives, true);
+    }
     //三步走--事件监控-》就绪事件处理-》执行任务
      void Start() {
+        using Clock = std::chrono::steady_clock;
+        _clock->SetDriven(true);
         while(true) {
             //1. 事件监控，
-            std::vector<Channel *> actives;
-            _poller.Poll(&actives);
+            _actives.clear();
+            auto poll_start = Clock::now();
+            Wait();
+            auto poll_end = Clock::now();
+            _clock->Update();
             //2. 事件处理。
-            for (auto &channel : actives) {
+            _handling_events = true;
+            for (auto &channel : _actives) {
                 channel->HandleEvent();
             }
+            //io_uring完成的accept/recv/send
+            size_t completions = _poller->Dispatch();
+            _handling_events = false;
             //3. 执行任务
             RunAllTask();
+            auto handle_end = Clock::now();
+            _stats.events_per_wakeup.Record(_actives.size() + completions);
+            _stats.poll_us.Record(std::chrono::duration_cast<std::chrono::microseconds>(poll_end - poll_start).count());
+            _stats.handle_us.Record(std::chrono::duration_cast<std::chrono::microseconds>(handle_end - poll_end).count());
         }
     }
     //用于判断当前线程是否是EventLoop对应的线程；
@@ -98,41 +182,123 @@ public:
         assert(_thread_id == std::this_thread::get_id());
     }
     //判断将要执行的任务是否处于当前线程中，如果是则执行，不是则压入队列。
-    void RunInLoop(const Functor &cb) {
+    void RunInLoop(Functor cb) {
         if (IsInLoop()) {
             return cb();
         }
-        return QueueInLoop(cb);
+        return QueueInLoop(std::move(cb));
     }
     //将操作压入任务池
-    void QueueInLoop(const Functor &cb) {
-        {
-            std::unique_lock<std::mutex> _lock(_mutex);
-            _tasks.push_back(cb);
-        }
+    void QueueInLoop(Functor cb) {
+        bool was_empty = _tasks.Push(std::move(cb));
         //唤醒有可能因为没有事件就绪，而导致的epoll阻塞；
         //其实就是给eventfd写入一个数据，eventfd就会触发可读事件
+        //只有让任务池从空变为非空的那次投递需要唤醒，之前的投递已经唤醒过，EventLoop会把任务池一次取完
+        //EventLoop线程在处理就绪事件时投递的任务，处理完事件后马上就会执行，也不需要唤醒
+        if (!was_empty || (IsInLoop() && _handling_events)) return;
+        _stats.wakeups.fetch_add(1, std::memory_order_relaxed);
         WeakUpEventFd();
     }
     //添加/修改描述符的事件监控
-    void UpdateEvent(Channel *channel) { return _poller.UpdateEvent(channel); }
+    void UpdateEvent(Channel *channel) { return _poller->UpdateEvent(channel); }
     //移除描述符的监控
-    void RemoveEvent(Channel *channel) { return _poller.RemoveEvent(channel); }
-    void TimerAdd(uint64_t id, uint32_t delay, const TaskFunc &cb) { return _timer_wheel.TimerAdd(id, delay, cb); }
-    void TimerRefresh(uint64_t id) { return _timer_wheel.TimerRefresh(id); }
-    void TimerCancel(uint64_t id) { return _timer_wheel.TimerCancel(id); }
-    bool HasTimer(uint64_t id) { return _timer_wheel.HasTimer(id); }
+    void RemoveEvent(Channel *channel) { return _poller->RemoveEvent(channel); }
+    //是否由io_uring完成accept/recv/send，连接和监听套接字据此选择读写方式，构造之后不会改变，可以在任意线程读取
+    bool AsyncIo() const { return _poller->AsyncIo(); }
+    //提交发送请求，随下一次等待一起提交，完成时调用channel->HandleSent；只能在AsyncIo()为真时调用
+    void SubmitSend(Channel *channel, const struct iovec *iov, int cnt, std::shared_ptr<void> hold) {
+        return _poller->SubmitSend(channel, iov, cnt, std::move(hold));
+    }
+    //设置内存池的高低水位，空闲内存超过高水位时归还到低水位
+    void SetPoolWatermark(uint64_t high, uint64_t low) {
+        RunInLoop([this, high, low] { _mem_pool->SetWatermark(high, low); });
+    }
+    //设置进入阻塞等待之前自旋轮询的时间，0表示不自旋，自旋会占满所在的CPU
+    void SetBusyPoll(uint32_t usec) {
+        RunInLoop([this, usec] { _busy_poll_us = usec; });
+    }
+    //内存池统计信息，可以在任意线程读取
+    PoolStats GetPoolStats() const { return _mem_pool->Stats(); }
+    LoopStats &Stats() { return _stats; }
+    //epoll相关系统调用的统计信息，可以在任意线程读取
+    PollerStats &GetPollerStats() { return _poller->Stats(); }
+    //实际使用的事件监控方式
+    const char *PollerName() { return _poller->Name(); }
+    //实际使用的定时器实现
+    const char *TimerName() { return _timer_queue->Name(); }
+    //所有定时接口的参数顺序都是：ID(如果有)、时间、回调；时间都是std::chrono的时长或者steady_clock的时间点
+    //添加定时任务，同ID的定时任务已经存在时替换掉
+    void TimerAdd(uint64_t id, TimerDuration delay, TaskFunc cb) {
+        return _timer_queue->TimerAdd(id, ToDelayMs(delay), std::move(cb));
+    }
+    //空闲超时任务：*stamp超过timeout没有更新时执行cb，使用者只需要在活动时更新*stamp(用PollTimeMs)，不需要刷新定时器
+    //stamp必须在任务执行或者取消之前一直有效
+    void TimerAddIdle(uint64_t id, TimerDuration timeout, const uint64_t *stamp, TaskFunc cb) {
+        return _timer_queue->TimerAdd(id, ToDelayMs(timeout), std::move(cb), stamp);
+    }
+    //本轮事件等待返回的时间，CLOCK_MONOTONIC毫秒，和定时器使用同一个时钟，只能在EventLoop线程中使用
+    uint64_t PollTimeMs() const { return _clock->MonoMs(); }
+    //本轮缓存的时间，只能在EventLoop线程中使用；其他代码也可以直接用LoopClock::Local()
+    LoopClock &Now() { return *_clock; }
+    //缓存的时间改用CLOCK_*_COARSE读取，更新更便宜，精度降到一个内核节拍；定时器到期仍然按精确时钟判断
+    void SetCoarseClock(bool coarse) {
+        RunInLoop([this, coarse] { _clock->SetCoarse(coarse); });
+    }
+    void TimerRefresh(uint64_t id) { return _timer_queue->TimerRefresh(id); }
+    void TimerCancel(uint64_t id) { return _timer_queue->TimerCancel(id); }
+    bool HasTimer(uint64_t id) { return _timer_queue->HasTimer(id); }
+    //转换成定时器的毫秒刻度，向上取整，不会提前执行
+    static uint64_t ToTimerMs(std::chrono::steady_clock::time_point when) {
+        int64_t ms = std::chrono::ceil<std::chrono::milliseconds>(when.time_since_epoch()).count();
+        return ms > 0 ? ms : 0;
+    }
+    static uint32_t ToDelayMs(TimerDuration delay) {
+        int64_t ms = std::chrono::ceil<std::chrono::milliseconds>(delay).count();
+        return (uint32_t)std::clamp<int64_t>(ms, 0, UINT32_MAX);
+    }
+    //通用定时任务，ID由时间轮分配，返回的句柄用于取消，任意线程都可以调用
+    //其他线程的添加和取消通过任务池投递，一批投递只唤醒一次，时间轮只在到期时间更早时重新设置timerfd
+    //在steady_clock的时间点执行一次，已经过去的时间点尽快执行
+    TimerId RunAt(std::chrono::steady_clock::time_point when, TaskFunc cb) {
+        uint64_t id = _timer_queue->NewTimerId();
+        _timer_queue->TimerAddAt(id, ToTimerMs(when), 0, std::move(cb));
+        return TimerId(id);
+    }
+    //delay之后执行一次
+    TimerId RunAfter(TimerDuration delay, TaskFunc cb) {
+        return RunAt(std::chrono::steady_clock::now() + delay, std::move(cb));
+    }
+    //每隔interval执行一次，第一次在interval之后，直到取消；周期最短1毫秒
+    TimerId RunEvery(TimerDuration interval, TaskFunc cb) {
+        uint64_t id = _timer_queue->NewTimerId();
+        uint32_t interval_ms = std::max<uint32_t>(ToDelayMs(interval), 1);
+        auto first = std::chrono::steady_clock::now() + std::chrono::milliseconds(interval_ms);
+        _timer_queue->TimerAddAt(id, ToTimerMs(first), interval_ms, std::move(cb));
+        return TimerId(id);
+    }
+    //取消还没有执行的任务，周期任务可以在自己的回调中取消自己
+    void Cancel(TimerId timer) {
+        if (timer.Valid()) _timer_queue->TimerCancel(timer.Id());
+    }
 };
 
 void Channel::Remove() { return _loop->RemoveEvent(this); }
 void Channel::Update() { return _loop->UpdateEvent(this); }
-void TimerWheel::TimerAdd(uint64_t id, uint32_t delay, const TaskFunc &cb) {
-    _loop->RunInLoop([this, id, delay, cb] { TimerAddInLoop(id, delay, cb); });
+void TimerQueue::TimerAdd(uint64_t id, uint32_t delay, TaskFunc cb, const uint64_t *stamp) {
+    //在EventLoop线程中直接添加，避免把任务再包装一层
+    if (_loop->IsInLoop()) return TimerAddInLoop(id, delay, std::move(cb), stamp);
+    _loop->QueueInLoop([this, id, delay, stamp, cb = std::move(cb)]() mutable { TimerAddInLoop(id, delay, std::move(cb), stamp); });
+}
+void TimerQueue::TimerAddAt(uint64_t id, uint64_t expire, uint32_t interval, TaskFunc cb) {
+    if (_loop->IsInLoop()) return TimerAddAtInLoop(id, expire, interval, std::move(cb), nullptr, interval > 0);
+    _loop->QueueInLoop([this, id, expire, interval, cb = std::move(cb)]() mutable {
+        TimerAddAtInLoop(id, expire, interval, std::move(cb), nullptr, interval > 0);
+    });
 }
 //刷新/延迟定时任务
-void TimerWheel::TimerRefresh(uint64_t id) {
+void TimerQueue::TimerRefresh(uint64_t id) {
     _loop->RunInLoop([this, id] { TimerRefreshInLoop(id); });
 }
-void TimerWheel::TimerCancel(uint64_t id) {
+void TimerQueue::TimerCancel(uint64_t id) {
     _loop->RunInLoop([this, id] { TimerCancelInLoop(id); });
 }
\ No newline at end of file
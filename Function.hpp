@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#define FUNCTION_INLINE_SIZE 48     //可调用对象不超过这个大小时直接存放在对象内部，不申请堆内存
+
+template<typename Signature>
+class UniqueFunction;
+
+//只能移动不能拷贝的可调用对象包装，用于事件回调、任务池和定时任务
+//和std::function相比，可以保存只能移动的对象，内部缓冲区更大，捕获this加几个参数的lambda不会申请堆内存
+//任务投递之后只会被执行一次，转移所有权即可，不需要拷贝
+template<typename R, typename... Args>
+class UniqueFunction<R(Args...)> {
+private:
+    struct Ops {
+        R (*invoke)(void *, Args &&...);
+        void (*move)(void *dst, void *src);     //移动构造到dst，并析构src
+        void (*destroy)(void *);
+    };
+    //放在内部缓冲区中的可调用对象
+    template<typename F>
+    struct InlineOps {
+        static R Invoke(void *p, Args &&...args) { return (*static_cast<F *>(p))(std::forward<Args>(args)...); }
+        static void Move(void *dst, void *src) {
+            ::new (dst) F(std::move(*static_cast<F *>(src)));
+            static_cast<F *>(src)->~F();
+        }
+        static void Destroy(void *p) { static_cast<F *>(p)->~F(); }
+        static constexpr Ops ops{Invoke, Move, Destroy};
+    };
+    //放不下的，在堆上申请，内部缓冲区中只保存指针
+    template<typename F>
+    struct HeapOps {
+        static F *&Ptr(void *p) { return *static_cast<F **>(p); }
+        static R Invoke(void *p, Args &&...args) { return (*Ptr(p))(std::forward<Args>(args)...); }
+        static void Move(void *dst, void *src) { ::new (dst) F *(Ptr(src)); }
+        static void Destroy(void *p) { delete Ptr(p); }
+        static constexpr Ops ops{Invoke, Move, Destroy};
+    };
+    template<typename F>
+    static constexpr bool IsInline = sizeof(F) <= FUNCTION_INLINE_SIZE &&
+                                     alignof(F) <= alignof(std::max_align_t) &&
+                                     std::is_nothrow_move_constructible_v<F>;
+
+    alignas(std::max_align_t) unsigned char _storage[FUNCTION_INLINE_SIZE];
+    const Ops *_ops;
+private:
+    void Reset() {
+        if (_ops) _ops->destroy(_storage);
+        _ops = nullptr;
+    }
+    void MoveFrom(UniqueFunction &other) {
+        if (other._ops) other._ops->move(_storage, other._storage);
+        _ops = other._ops;
+        other._ops = nullptr;
+    }
+public:
+    UniqueFunction() noexcept:_ops(nullptr) {}
+    UniqueFunction(std::nullptr_t) noexcept:_ops(nullptr) {}
+    template<typename F, typename D = std::decay_t<F>,
+             typename = std::enable_if_t<!std::is_same_v<D, UniqueFunction> && std::is_invocable_r_v<R, D &, Args...>>>
+    UniqueFunction(F &&f):_ops(nullptr) {
+        if constexpr (std::is_pointer_v<D> || std::is_member_pointer_v<D>) {
+            if (f == nullptr) return;
+        }
+        if constexpr (IsInline<D>) {
+            ::new (static_cast<void *>(_storage)) D(std::forward<F>(f));
+            _ops = &InlineOps<D>::ops;
+        }else {
+            ::new (static_cast<void *>(_storage)) D *(new D(std::forward<F>(f)));
+            _ops = &HeapOps<D>::ops;
+        }
+    }
+    UniqueFunction(UniqueFunction &&other) noexcept { MoveFrom(other); }
+    UniqueFunction &operator=(UniqueFunction &&other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+    UniqueFunction &operator=(std::nullptr_t) noexcept {
+        Reset();
+        return *this;
+    }
+    UniqueFunction(const UniqueFunction &) = delete;
+    UniqueFunction &operator=(const UniqueFunction &) = delete;
+    ~UniqueFunction() { Reset(); }
+
+    explicit operator bool() const noexcept { return _ops != nullptr; }
+    R operator()(Args... args) { return _ops->invoke(_storage, std::forward<Args>(args)...); }
+};
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <ctime>
 #include <cstdarg>
+#include "Clock.hpp"
 
 
 #define INF 0
@@ -12,11 +13,8 @@
 
 #define LOG(level, format, ...) do      {\
         if (level < LOG_LEVEL) break;\
-        time_t t = time(NULL);\
-        struct tm *ltm = localtime(&t);\
-        char tmp[32] = {0};\
-        strftime(tmp, 31, "%H:%M:%S", ltm);\
-        fprintf(stdout, "[%p %s %s:%d] " format "\n", (void*)pthread_self(), tmp, __FILE__, __LINE__, ##__VA_ARGS__);\
+        /*时间字符串由当前线程的LoopClock按秒缓存，EventLoop线程中不需要读时钟和格式化*/\
+        fprintf(stdout, "[%p %s %s:%d] " format "\n", (void*)pthread_self(), LoopClock::Local().LogTime(), __FILE__, __LINE__, ##__VA_ARGS__);\
     }             while(0)
 
 #define INF_LOG(format, ...) LOG(INF, format, ##__VA_ARGS__)
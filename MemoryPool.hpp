@@ -0,0 +1,203 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cassert>
+#include <new>
+#include <mutex>
+
+#define POOL_ALIGN 64                       //块大小按64字节分级
+#define POOL_MAX_BLOCK 16384                //超过这个大小的申请直接走系统分配，不进内存池
+#define POOL_HIGH_WATERMARK (64 << 20)      //缓存的空闲内存超过高水位时开始归还给系统
+#define POOL_LOW_WATERMARK (16 << 20)       //一直归还到低水位为止
+
+struct PoolStats {
+    uint64_t alloc_count;   //申请次数
+    uint64_t hit_count;     //从空闲链表直接拿到内存的次数
+    uint64_t free_count;    //释放次数
+    uint64_t trim_count;    //超过高水位后归还给系统的块数
+    uint64_t cached_bytes;  //当前缓存的空闲内存大小
+    uint64_t remote_count;  //其他线程释放、还给这个内存池的次数
+};
+
+//线程本地的分级内存池，缓冲区分段和Connection对象都从这里申请
+//每个EventLoop运行在自己的线程上，因此每个EventLoop独享一个内存池，申请和本线程的释放都不需要加锁
+//内存块总是回到申请它的内存池：使用者记住申请时的内存池，在其他线程释放时挂到所属内存池的无锁链表上，
+//所属线程下一次申请时统一收回，内存块不会在线程之间漂移
+class MemoryPool {
+private:
+    //其他线程释放的内存块，借用块本身的空间串成链表
+    struct RemoteBlock {
+        RemoteBlock *next;
+        size_t size;
+    };
+    std::vector<std::vector<void *>> _free;    //按大小分级的空闲链表
+    uint64_t _high_watermark;
+    uint64_t _low_watermark;
+    std::atomic<RemoteBlock *> _remote;         //其他线程还回来的内存块，多个线程压入，所属线程一次取走
+    std::atomic<bool> _orphaned;                //所属线程已经退出，还回来的内存块直接归还给系统
+    //统计信息只有所属线程写，其他线程可以随时读
+    std::atomic<uint64_t> _alloc_count;
+    std::atomic<uint64_t> _hit_count;
+    std::atomic<uint64_t> _free_count;
+    std::atomic<uint64_t> _trim_count;
+    std::atomic<uint64_t> _cached_bytes;
+    std::atomic<uint64_t> _remote_count;       //其他线程写，使用原子加
+private:
+    static size_t ClassIndex(size_t size) { return (size + POOL_ALIGN - 1) / POOL_ALIGN - 1; }
+    static size_t ClassSize(size_t idx) { return (idx + 1) * POOL_ALIGN; }
+    static void Add(std::atomic<uint64_t> &val, int64_t n) {
+        val.store(val.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    void FreeLocal(void *ptr, size_t size) {
+        size_t idx = ClassIndex(size);
+        _free[idx].push_back(ptr);
+        Add(_cached_bytes, ClassSize(idx));
+    }
+    //收回其他线程还回来的内存块
+    void DrainRemote() {
+        RemoteBlock *block = _remote.exchange(nullptr, std::memory_order_acquire);
+        while (block != nullptr) {
+            RemoteBlock *next = block->next;
+            FreeLocal(block, block->size);
+            block = next;
+        }
+        if (_cached_bytes.load(std::memory_order_relaxed) > _high_watermark) Trim();
+    }
+    //其他线程释放属于这个内存池的内存块
+    void FreeRemote(void *ptr, size_t size) {
+        _remote_count.fetch_add(1, std::memory_order_relaxed);
+        //所属线程已经退出，没有人会来收回了；退出和压入同时发生时这一块会泄漏，不会访问已经释放的内存
+        if (_orphaned.load(std::memory_order_acquire)) {
+            ::operator delete(ptr);
+            return;
+        }
+        RemoteBlock *block = static_cast<RemoteBlock *>(ptr);
+        block->size = size;
+        block->next = _remote.load(std::memory_order_relaxed);
+        while (!_remote.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+    //线程退出时释放缓存的内存，内存池对象本身保留，之后还回来的内存块直接归还给系统
+    void Orphan() {
+        _orphaned.store(true, std::memory_order_release);
+        DrainRemote();
+        for (auto &list : _free) {
+            for (auto ptr : list) ::operator delete(ptr);
+            list.clear();
+        }
+        _cached_bytes.store(0, std::memory_order_relaxed);
+    }
+    //线程退出后内存池对象仍然可能被其他线程引用，不释放，放在这里保持可达
+    static void Retire(MemoryPool *pool) {
+        static std::mutex mutex;
+        static auto *retired = new std::vector<MemoryPool *>;//不随进程退出析构，其他线程的静态对象析构时还可能还回内存块
+        pool->Orphan();
+        std::lock_guard<std::mutex> lock(mutex);
+        retired->push_back(pool);
+    }
+    //空闲内存超过高水位，从大块开始归还给系统，直到降到低水位
+    void Trim() {
+        for (size_t i = _free.size(); i-- > 0;) {
+            auto &list = _free[i];
+            while (!list.empty() && _cached_bytes.load(std::memory_order_relaxed) > _low_watermark) {
+                ::operator delete(list.back());
+                list.pop_back();
+                Add(_cached_bytes, -(int64_t)ClassSize(i));
+                Add(_trim_count, 1);
+            }
+        }
+    }
+public:
+    MemoryPool():_free(POOL_MAX_BLOCK / POOL_ALIGN), _high_watermark(POOL_HIGH_WATERMARK),
+                 _low_watermark(POOL_LOW_WATERMARK), _remote(nullptr), _orphaned(false),
+                 _alloc_count(0), _hit_count(0), _free_count(0), _trim_count(0), _cached_bytes(0),
+                 _remote_count(0) {}
+    ~MemoryPool() {
+        DrainRemote();
+        for (auto &list : _free) {
+            for (auto ptr : list) ::operator delete(ptr);
+        }
+    }
+    MemoryPool(const MemoryPool &) = delete;
+    MemoryPool &operator=(const MemoryPool &) = delete;
+    //当前线程的内存池
+    //线程退出时内存池不释放，其他线程手中属于它的内存块还可以安全地还回来
+    static MemoryPool &Local() {
+        struct Holder {
+            MemoryPool *pool = new MemoryPool;
+            ~Holder() { Retire(pool); }
+        };
+        thread_local Holder holder;
+        return *holder.pool;
+    }
+    //只能在所属线程中调用
+    void *Allocate(size_t size) {
+        Add(_alloc_count, 1);
+        if (size == 0) size = 1;
+        if (size > POOL_MAX_BLOCK) {
+            return ::operator new(size);
+        }
+        if (_remote.load(std::memory_order_relaxed) != nullptr) DrainRemote();
+        size_t idx = ClassIndex(size);
+        auto &list = _free[idx];
+        if (list.empty()) {
+            return ::operator new(ClassSize(idx));
+        }
+        void *ptr = list.back();
+        list.pop_back();
+        Add(_hit_count, 1);
+        Add(_cached_bytes, -(int64_t)ClassSize(idx));
+        return ptr;
+    }
+    //ptr必须是从这个内存池申请的，size必须和申请时的大小一致；可以在任意线程调用
+    void Deallocate(void *ptr, size_t size) {
+        if (ptr == nullptr) return;
+        if (size == 0) size = 1;
+        if (size > POOL_MAX_BLOCK) {
+            ::operator delete(ptr);
+            return;
+        }
+        if (this != &Local()) return FreeRemote(ptr, size);
+        Add(_free_count, 1);
+        FreeLocal(ptr, size);
+        if (_cached_bytes.load(std::memory_order_relaxed) > _high_watermark) Trim();
+    }
+    //设置高低水位，只能在所属线程中调用
+    void SetWatermark(uint64_t high, uint64_t low) {
+        assert(low <= high);
+        _high_watermark = high;
+        _low_watermark = low;
+        if (_cached_bytes.load(std::memory_order_relaxed) > _high_watermark) Trim();
+    }
+    PoolStats Stats() const {
+        PoolStats stats{};
+        stats.alloc_count = _alloc_count.load(std::memory_order_relaxed);
+        stats.hit_count = _hit_count.load(std::memory_order_relaxed);
+        stats.free_count = _free_count.load(std::memory_order_relaxed);
+        stats.trim_count = _trim_count.load(std::memory_order_relaxed);
+        stats.cached_bytes = _cached_bytes.load(std::memory_order_relaxed);
+        stats.remote_count = _remote_count.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+//从当前线程内存池申请内存的分配器，用于std::allocate_shared等标准容器接口
+//分配器记住构造时所在线程的内存池，在其他线程释放时也还给这个内存池
+template<typename T>
+class PoolAllocator {
+private:
+    template<typename U> friend class PoolAllocator;
+    MemoryPool *_pool;
+public:
+    using value_type = T;
+    PoolAllocator():_pool(&MemoryPool::Local()) {}
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U> &other):_pool(other._pool) {}
+    T *allocate(size_t n) { return static_cast<T *>(_pool->Allocate(n * sizeof(T))); }
+    void deallocate(T *ptr, size_t n) { _pool->Deallocate(ptr, n * sizeof(T)); }
+    template<typename U>
+    bool operator==(const PoolAllocator<U> &other) const { return _pool == other._pool; }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U> &other) const { return _pool != other._pool; }
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include "MemoryPool.hpp"
+
+//多生产者单消费者的无锁队列，用于其他线程向EventLoop投递任务
+//生产者用CAS把节点压到链表头部，消费者一次把整条链表取走，反转成先进先出的顺序后依次执行
+//消费者一次只处理取走时已经在队列中的任务，执行过程中新投递的任务留到下一轮
+//节点从投递线程的内存池申请，消费后还给投递线程的内存池，EventLoop线程给自己投递任务时不需要申请堆内存
+template<typename T>
+class MpscQueue {
+private:
+    struct Node {
+        T value;
+        Node *next;
+        MemoryPool *pool;   //申请节点的内存池
+    };
+    std::atomic<Node *> _head;
+private:
+    static Node *NewNode(T &&value) {
+        MemoryPool *pool = &MemoryPool::Local();
+        void *ptr = pool->Allocate(sizeof(Node));
+        return ::new (ptr) Node{std::move(value), nullptr, pool};
+    }
+    static void DeleteNode(Node *node) {
+        MemoryPool *pool = node->pool;
+        node->~Node();
+        pool->Deallocate(node, sizeof(Node));
+    }
+    static Node *Reverse(Node *node) {
+        Node *prev = nullptr;
+        while (node) {
+            Node *next = node->next;
+            node->next = prev;
+            prev = node;
+            node = next;
+        }
+        return prev;
+    }
+public:
+    MpscQueue():_head(nullptr) {}
+    ~MpscQueue() {
+        Node *node = _head.exchange(nullptr, std::memory_order_acquire);
+        while (node) {
+            Node *next = node->next;
+            DeleteNode(node);
+            node = next;
+        }
+    }
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+    //任意线程调用，返回投递之前队列是否为空
+    bool Push(T value) {
+        Node *node = NewNode(std::move(value));
+        Node *old = _head.load(std::memory_order_relaxed);
+        do {
+            node->next = old;
+        } while (!_head.compare_exchange_weak(old, node, std::memory_order_release, std::memory_order_relaxed));
+        return old == nullptr;
+    }
+    //只能在消费者线程调用，取走当前所有元素，按投递顺序对每个元素调用f，返回处理的个数
+    template<typename F>
+    size_t ConsumeAll(F &&f) {
+        Node *node = Reverse(_head.exchange(nullptr, std::memory_order_acquire));
+        size_t count = 0;
+        while (node) {
+            Node *next = node->next;
+            f(node->value);
+            DeleteNode(node);
+            node = next;
+            count++;
+        }
+        return count;
+    }
+    bool Empty() const { return _head.load(std::memory_order_acquire) == nullptr; }
+};
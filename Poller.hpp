@@ -2,82 +2,102 @@
 
 #include "Log.hpp"
 #include "Channel.hpp"
-#include <unordered_map>
 #include <vector>
-#include <cstring>
+#include <memory>
+#include <atomic>
+#include <algorithm>
 #include <cassert>
-#include <sys/epoll.h>
+#include <sys/uio.h>
 
-#define MAX_EPOLLEVENTS 4096
+//Poller的系统调用统计，所属线程更新，其他线程可以随时读取
+struct PollerStats {
+    std::atomic<uint64_t> ctl_calls{0};         //epoll_ctl调用次数，io_uring是等待之外单独提交请求的次数
+    std::atomic<uint64_t> wait_calls{0};        //epoll_wait/io_uring_enter等待的次数，包括不阻塞的轮询
+    std::atomic<uint64_t> skipped_updates{0};   //事件没有变化，省掉的修改次数
+    std::atomic<uint64_t> events_capacity{0};   //当前就绪事件数组的大小
+    std::atomic<uint64_t> submitted{0};         //io_uring提交的请求数，随等待一起提交，不单独产生系统调用
+    std::atomic<uint64_t> completions{0};       //io_uring完成的accept/recv/send个数，这些I/O不需要单独的系统调用
+};
 
+//事件监控的实现方式
+enum class PollerType {
+    EPOLL,
+    URING       //内核支持时accept/recv/send也由io_uring完成；只支持poll时只做事件监控；都不支持时退回epoll
+};
 
+//事件监控的接口，EventLoop只通过这个接口使用
+//公共部分：按描述符下标保存Channel，记录一轮中修改过监控事件的Channel，在下一次等待之前统一提交
 class Poller {
-private:
-    int _epfd;
-    struct epoll_event _evs[MAX_EPOLLEVENTS]{};
-    std::unordered_map<int, Channel *> _channels;
-private:
-    //对epoll的直接操作
-    void Update(Channel *channel, int op) {
-        // int epoll_ctl(int epfd, int op,  int fd,  struct epoll_event *ev);
-        int fd = channel->Fd();
-        struct epoll_event ev{};
-        ev.data.fd = fd;
-        ev.events = channel->Events();
-        int ret = epoll_ctl(_epfd, op, fd, &ev);
-        if (ret < 0) {
-            ERR_LOG("EPOLLCTL FAILED!");
-        }
+protected:
+    std::vector<Channel *> _channels;   //按描述符下标保存添加过的Channel，描述符是从小到大分配的整数
+    std::vector<Channel *> _dirty;      //监控事件有修改，等待下一次等待之前统一提交的Channel
+    PollerStats _stats;
+protected:
+    static void Add(std::atomic<uint64_t> &val, uint64_t n) {
+        val.store(val.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
     }
     //判断一个Channel是否已经添加了事件监控
     bool HasChannel(Channel *channel) {
-        auto it = _channels.find(channel->Fd());
-        if (it == _channels.end()) {
-            return false;
-        }
-        return true;
+        int fd = channel->Fd();
+        return fd >= 0 && (size_t)fd < _channels.size() && _channels[fd] == channel;
     }
-public:
-    Poller() {
-        _epfd = epoll_create(MAX_EPOLLEVENTS);
-        if (_epfd < 0) {
-            ERR_LOG("EPOLL CREATE FAILED!!");
-            abort();//退出程序
-        }
+    Channel *FindChannel(int fd) {
+        return fd >= 0 && (size_t)fd < _channels.size() ? _channels[fd] : nullptr;
     }
-    //添加或修改监控事件
-    void UpdateEvent(Channel *channel) {
-        bool ret = HasChannel(channel);
-        if (!ret) {
-            _channels.insert(std::make_pair(channel->Fd(), channel));
-            return Update(channel, EPOLL_CTL_ADD);
+    void MarkDirty(Channel *channel) {
+        if (!channel->Dirty()) {
+            channel->SetDirty(true);
+            _dirty.push_back(channel);
         }
-        return Update(channel, EPOLL_CTL_MOD);
     }
-    //移除监控
-    void RemoveEvent(Channel *channel) {
-        auto it = _channels.find(channel->Fd());
-        if (it != _channels.end()) {
-            _channels.erase(it);
+    //从待提交列表和表中去掉，之后的修改和就绪事件都不会再涉及这个Channel
+    void Forget(Channel *channel) {
+        if (channel->Dirty()) {
+            _dirty.erase(std::find(_dirty.begin(), _dirty.end(), channel));
+            channel->SetDirty(false);
+        }
+        if (HasChannel(channel)) {
+            _channels[channel->Fd()] = nullptr;
         }
-        Update(channel, EPOLL_CTL_DEL);
     }
-    //开始监控，返回活跃连接
-    void Poll(std::vector<Channel*> *active) {
-        // int epoll_wait(int epfd, struct epoll_event *evs, int maxevents, int timeout)
-        int nfds = epoll_wait(_epfd, _evs, MAX_EPOLLEVENTS, -1);
-        if (nfds < 0) {
-            if (errno == EINTR) {
-                return ;
-            }
-            ERR_LOG("EPOLL WAIT ERROR:%s\n", strerror(errno));
-            abort();//退出程序
+    void ApplyChanges() {
+        for (auto channel : _dirty) {
+            ApplyChange(channel);
         }
-        for (int i = 0; i < nfds; i++) {
-            auto it = _channels.find(_evs[i].data.fd);
-            assert(it != _channels.end());
-            it->second->SetREvents(_evs[i].events);//设置实际就绪的事件
-            active->push_back(it->second);
+        _dirty.clear();
+    }
+    //把Channel最终的监控事件提交给内核
+    virtual void ApplyChange(Channel *channel) = 0;
+public:
+    virtual ~Poller() {}
+    //添加或修改监控事件，只做记录，在下一次等待之前统一提交
+    //一轮事件处理中同一个Channel的多次修改只会提交一次，改回原样的不会提交
+    void UpdateEvent(Channel *channel) {
+        if (channel->State() == ChannelState::NEW) {
+            int fd = channel->Fd();
+            if ((size_t)fd >= _channels.size()) _channels.resize(fd + 1, nullptr);
+            _channels[fd] = channel;
+            channel->SetState(ChannelState::DELETED);
         }
+        assert(HasChannel(channel));
+        MarkDirty(channel);
+    }
+    //移除监控，调用之后Channel可能马上就被释放，描述符也会被关闭
+    virtual void RemoveEvent(Channel *channel) = 0;
+    //开始监控，就绪的Channel追加到active中；block为false时只检查一次，没有就绪事件也立即返回
+    virtual void Poll(std::vector<Channel*> *active, bool block) = 0;
+    virtual const char *Name() const = 0;
+    PollerStats &Stats() { return _stats; }
+    //是否支持完成通知的I/O：ChannelIo::ACCEPT/RECV的Channel启动读事件后由内核完成accept/recv，
+    //结果通过Channel的完成回调通知，不再有可读事件；发送用SubmitSend提交
+    virtual bool AsyncIo() const { return false; }
+    //提交发送，完成时调用channel->HandleSent；iov中的数据在完成之前必须保持不变，hold一直持有到完成
+    //同一个Channel同时只能有一个发送，只有AsyncIo()为真时可以调用
+    virtual void SubmitSend(Channel *, const struct iovec *, int, std::shared_ptr<void>) {
+        ERR_LOG("%s DOES NOT SUPPORT ASYNC SEND!", Name());
+        abort();
     }
+    //Poll收到的完成事件在处理完就绪事件之后处理，调用Channel的完成回调，返回处理的个数
+    virtual size_t Dispatch() { return 0; }
+    virtual bool HasCompletions() const { return false; }
 };
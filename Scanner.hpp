@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCANNER_X86 1
+#endif
+
+//扫描使用的实现，测试和基准程序可以指定其中一种
+enum class ScanKernel {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+//字节扫描：一次扫描找出多个分隔符的位置，x86上优先使用AVX2，其次SSE2，其他平台逐字节扫描
+class Scanner {
+private:
+    using FindAllFunc = size_t (*)(const char *, const char *, char, size_t *, size_t, const char **);
+
+    static size_t FindAllScalar(const char *begin, const char *end, char ch, size_t *offs, size_t max, const char **stop) {
+        size_t n = 0;
+        for (const char *p = begin; p < end; p++) {
+            if (*p != ch) continue;
+            offs[n++] = p - begin;
+            if (n == max) {
+                *stop = p + 1;
+                return n;
+            }
+        }
+        *stop = end;
+        return n;
+    }
+    //处理向量化部分剩下的不足一个块的尾部数据
+    static size_t FindAllTail(const char *begin, const char *p, const char *end, char ch,
+                              size_t *offs, size_t n, size_t max, const char **stop) {
+        size_t cnt = FindAllScalar(p, end, ch, offs + n, max - n, stop);
+        for (size_t i = n; i < n + cnt; i++) offs[i] += p - begin;
+        return n + cnt;
+    }
+    //把一个块的匹配掩码展开成偏移，找够max个返回true
+    static bool Collect(uint32_t mask, const char *begin, const char *p, size_t *offs, size_t *n, size_t max, const char **stop) {
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            offs[(*n)++] = p - begin + bit;
+            if (*n == max) {
+                *stop = p + bit + 1;
+                return true;
+            }
+            mask &= mask - 1;
+        }
+        return false;
+    }
+#ifdef SCANNER_X86
+    __attribute__((target("sse2")))
+    static size_t FindAllSse2(const char *begin, const char *end, char ch, size_t *offs, size_t max, const char **stop) {
+        size_t n = 0;
+        const char *p = begin;
+        const __m128i needle = _mm_set1_epi8(ch);
+        for (; p + 16 <= end; p += 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+            if (Collect(mask, begin, p, offs, &n, max, stop)) return n;
+        }
+        return FindAllTail(begin, p, end, ch, offs, n, max, stop);
+    }
+    __attribute__((target("avx2")))
+    static size_t FindAllAvx2(const char *begin, const char *end, char ch, size_t *offs, size_t max, const char **stop) {
+        size_t n = 0;
+        const char *p = begin;
+        const __m256i needle = _mm256_set1_epi8(ch);
+        for (; p + 32 <= end; p += 32) {
+            __m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+            if (Collect(mask, begin, p, offs, &n, max, stop)) return n;
+        }
+        return FindAllTail(begin, p, end, ch, offs, n, max, stop);
+    }
+#endif
+    static FindAllFunc Func(ScanKernel kernel) {
+#ifdef SCANNER_X86
+        if (kernel == ScanKernel::AVX2) return FindAllAvx2;
+        if (kernel == ScanKernel::SSE2) return FindAllSse2;
+#endif
+        return FindAllScalar;
+    }
+    //根据CPU支持的指令集选择实现，只在第一次调用时检测
+    static FindAllFunc Select() {
+        if (Supported(ScanKernel::AVX2)) return Func(ScanKernel::AVX2);
+        if (Supported(ScanKernel::SSE2)) return Func(ScanKernel::SSE2);
+        return Func(ScanKernel::SCALAR);
+    }
+public:
+    //当前CPU能否使用kernel
+    static bool Supported(ScanKernel kernel) {
+        if (kernel == ScanKernel::SCALAR) return true;
+#ifdef SCANNER_X86
+        __builtin_cpu_init();
+        if (kernel == ScanKernel::AVX2) return __builtin_cpu_supports("avx2");
+        if (kernel == ScanKernel::SSE2) return __builtin_cpu_supports("sse2");
+#endif
+        return false;
+    }
+    //和FindAll相同，但固定使用kernel，调用者保证Supported(kernel)
+    static size_t FindAllWith(ScanKernel kernel, const char *begin, const char *end, char ch,
+                              size_t *offs, size_t max, const char **stop) {
+        if (max == 0) {
+            *stop = begin;
+            return 0;
+        }
+        return Func(kernel)(begin, end, ch, offs, max, stop);
+    }
+    //在[begin, end)中查找最多max个ch，偏移(相对begin)写入offs，返回找到的个数
+    //找够max个时*stop指向最后一个匹配之后的位置，否则指向end
+    static size_t FindAll(const char *begin, const char *end, char ch, size_t *offs, size_t max, const char **stop) {
+        static const FindAllFunc func = Select();
+        if (max == 0) {
+            *stop = begin;
+            return 0;
+        }
+        return func(begin, end, ch, offs, max, stop);
+    }
+    //在[from, end)中查找第一个空行("\r\n"或者"\n")，line_begin是from之前最近的一个行首，用于判断from处的行
+    //返回空行之后的位置，没有找到返回nullptr
+    static const char *FindEmptyLine(const char *line_begin, const char *from, const char *end) {
+        size_t offs[32];
+        const char *stop = nullptr;
+        while (from < end) {
+            size_t n = FindAll(from, end, '\n', offs, 32, &stop);
+            for (size_t i = 0; i < n; i++) {
+                const char *q = from + offs[i];
+                //向前看，不会越过已经收到的数据
+                if (q == line_begin || q[-1] == '\n') return q + 1;
+                if (q[-1] == '\r' && (q - 1 == line_begin || q[-2] == '\n')) return q + 1;
+            }
+            from = stop;
+        }
+        return nullptr;
+    }
+};
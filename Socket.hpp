@@ -7,6 +7,7 @@
 #include <arpa/inet.h>
 #include <string>
 #include <fcntl.h>
+#include <sys/uio.h>
 #include "Log.hpp"
 
 #define MAX_LISTEN 1024
@@ -68,12 +69,17 @@ public:
         }
         return true;
     }
-    //获取新连接
+    //获取新连接，新连接直接设置为非阻塞并且exec时关闭，失败返回-1，errno保留accept的错误码
     int Accept() {
-        // int accept(int sockfd, struct sockaddr *addr, socklen_t *len);
-        int newfd = accept(_sockfd, NULL, NULL);
+        // int accept4(int sockfd, struct sockaddr *addr, socklen_t *len, int flags);
+        int newfd = accept4(_sockfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (newfd < 0) {
+            //非阻塞监听套接字上已经没有新连接了，不算错误；描述符耗尽由调用者处理
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED ||
+                errno == EMFILE || errno == ENFILE) return -1;
+            int err = errno;
             ERR_LOG("SOCKET ACCEPT FAILED!");
+            errno = err;
             return -1;
         }
         return newfd;
@@ -96,6 +102,21 @@ public:
     ssize_t NonBlockRecv(void *buf, size_t len) {
         return Recv(buf, len, MSG_DONTWAIT); // MSG_DONTWAIT 表示当前接收为非阻塞。
     }
+    //分散读，一次recvmsg把数据填充到多块缓冲区
+    ssize_t NonBlockRecvv(struct iovec *iov, int cnt) {
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = cnt;
+        ssize_t ret = recvmsg(_sockfd, &msg, MSG_DONTWAIT);
+        if (ret <= 0) {
+            if (ret < 0 && (errno == EAGAIN || errno == EINTR)) {
+                return 0;
+            }
+            ERR_LOG("SOCKET RECV FAILED!!");
+            return -1;
+        }
+        return ret;
+    }
     //发送数据
     ssize_t Send(const void *buf, size_t len, int flag = 0) {
         // ssize_t send(int sockfd, void *data, size_t len, int flag);
@@ -113,6 +134,22 @@ public:
         if (len == 0) return 0;
         return Send(buf, len, MSG_DONTWAIT); // MSG_DONTWAIT 表示当前发送为非阻塞。
     }
+    //聚集写，一次sendmsg发送多块缓冲区中的数据
+    ssize_t NonBlockSendv(const struct iovec *iov, int cnt) {
+        if (cnt == 0) return 0;
+        struct msghdr msg{};
+        msg.msg_iov = const_cast<struct iovec *>(iov);
+        msg.msg_iovlen = cnt;
+        ssize_t ret = sendmsg(_sockfd, &msg, MSG_DONTWAIT);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return 0;
+            }
+            ERR_LOG("SOCKET SEND FAILED!!");
+            return -1;
+        }
+        return ret;
+    }
     //关闭套接字
     void Close() {
         if (_sockfd != -1) {
@@ -139,10 +176,17 @@ public:
         return true;
     }
     //设置套接字选项---开启地址端口重用
+    //SO_REUSEPORT允许多个监听套接字绑定同一个端口，由内核在它们之间分配新连接
+    //两个选项是不同的选项名，不能按位或在一起设置
     void ReuseAddress() {
         // int setsockopt(int fd, int leve, int optname, void *val, int vallen)
         int val = 1;
-        setsockopt(_sockfd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, (void*)&val, sizeof(int));
+        setsockopt(_sockfd, SOL_SOCKET, SO_REUSEADDR, (void*)&val, sizeof(int));
+        setsockopt(_sockfd, SOL_SOCKET, SO_REUSEPORT, (void*)&val, sizeof(int));
+    }
+    //设置SO_BUSY_POLL：没有数据时内核在驱动队列上忙等usec微秒，超过net.core.busy_read需要CAP_NET_ADMIN
+    bool BusyPoll(int usec) {
+        return setsockopt(_sockfd, SOL_SOCKET, SO_BUSY_POLL, (void*)&usec, sizeof(int)) == 0;
     }
     //设置套接字阻塞属性-- 设置为非阻塞
     void NonBlock() {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <csignal>
+#include <unordered_map>
 #include "EventLoop.hpp"
 #include "Acceptor.hpp"
 #include "ThreadPool.hpp"
@@ -9,76 +10,230 @@
 using PtrConnection = Connection::PtrConnection;
 using Functor = std::function<void()>;
 
+//每个EventLoop线程管理的连接，以及SO_REUSEPORT模式下这个线程自己的监听套接字
+//连接在所属线程上构造、保存和移除，连接对象和缓冲区都从所属线程的内存池申请，不会在线程之间漂移
+struct LoopContext {
+    EventLoop *loop;
+    std::unique_ptr<Acceptor> acceptor;     //只在SO_REUSEPORT模式下创建
+    std::unordered_map<uint64_t, PtrConnection> conns;
+};
+
 class TcpServer {
 private:
-    uint64_t _next_id;      //这是一个自动增长的连接ID，
+    std::atomic<uint64_t> _next_id;      //这是一个自动增长的连接ID，多个线程accept时也不会重复
     int _port;
-    int _timeout{};           //这是非活跃连接的统计时间---多长时间无通信就是非活跃连接
+    TimerDuration _timeout{};   //这是非活跃连接的统计时间---多长时间无通信就是非活跃连接
     bool _enable_inactive_release;//是否启动了非活跃连接超时销毁的判断标志
+    BufferMode _in_buffer_mode;   //新连接输入缓冲区的模式
+    uint64_t _pool_high_watermark;//各个EventLoop内存池的高低水位
+    uint64_t _pool_low_watermark;
+    BufferShrinkPolicy _shrink_policy;      //连接缓冲区的收缩策略
+    std::shared_ptr<BufferQuota> _quota;    //所有连接共享的缓冲区配额，为空表示不限制
+    size_t _high_water_mark;        //连接输出缓冲区的高水位
+    bool _pause_read_on_high_water; //输出缓冲区超过高水位时是否暂停读取
+    bool _edge_triggered;           //监听套接字和新连接是否使用边缘触发模式
+    bool _reuse_port;               //是否每个从属线程各自监听、各自accept
+    int _accept_batch;              //一次可读事件最多获取的新连接个数
+    uint32_t _busy_poll_us;         //各个EventLoop阻塞等待之前自旋的时间
+    int _sock_busy_poll_us;         //新连接套接字的SO_BUSY_POLL，0表示不设置
+    bool _coarse_clock;             //各个EventLoop缓存的时间是否使用CLOCK_*_COARSE
     EventLoop _baseloop;    //这是主线程的EventLoop对象，负责监听事件的处理
     Acceptor _acceptor;    //这是监听套接字的管理对象
     LoopThreadPool _pool;   //这是从属EventLoop线程池
-    std::unordered_map<uint64_t, PtrConnection> _conns;//保存管理所有连接对应的shared_ptr对象
+    std::vector<std::unique_ptr<LoopContext>> _contexts;//各个EventLoop线程管理的连接
+    std::unordered_map<EventLoop *, LoopContext *> _loop_contexts;//Start时建立，之后只读
 
     using ConnectedCallback = std::function<void(const PtrConnection&)>;
     using MessageCallback = std::function<void(const PtrConnection&, Buffer *)>;
     using ClosedCallback = std::function<void(const PtrConnection&)>;
     using AnyEventCallback = std::function<void(const PtrConnection&)>;
+    using HighWaterMarkCallback = std::function<void(const PtrConnection&, size_t)>;
+    using WriteCompleteCallback = std::function<void(const PtrConnection&)>;
     using Functor = std::function<void()>;
     ConnectedCallback _connected_callback;
     MessageCallback _message_callback;
     ClosedCallback _closed_callback;
     AnyEventCallback _event_callback;
+    HighWaterMarkCallback _high_water_mark_callback;
+    WriteCompleteCallback _write_complete_callback;
 private:
-    void RunAfterInLoop(const Functor &task, int delay) {
-        _next_id++;
-        _baseloop.TimerAdd(_next_id, delay, task);
-    }
-    //为新连接构造一个Connection进行管理
-    void NewConnection(int fd) {
-        _next_id++;
-        PtrConnection conn(new Connection(_pool.NextLoop(), _next_id, fd));
+    //构造一个运行在loop上的Connection，设置好各种回调和参数
+    PtrConnection CreateConnection(EventLoop *loop, uint64_t id, int fd) {
+        //连接对象和shared_ptr控制块一起从当前线程(也就是loop所在线程)的内存池申请，释放后回收复用
+        PtrConnection conn = std::allocate_shared<Connection>(PoolAllocator<Connection>(), loop,
+                                                              id, fd, _in_buffer_mode);
         conn->SetMessageCallback(_message_callback);
         conn->SetClosedCallback(_closed_callback);
         conn->SetConnectedCallback(_connected_callback);
         conn->SetAnyEventCallback(_event_callback);
-        conn->SetSrvClosedCallback([this](auto && PH1) { RemoveConnection(std::forward<decltype(PH1)>(PH1)); });
+        conn->SetHighWaterMarkCallback(_high_water_mark_callback, _high_water_mark);
+        conn->SetWriteCompleteCallback(_write_complete_callback);
+        conn->SetPauseReadOnHighWater(_pause_read_on_high_water);
+        conn->SetShrinkPolicy(_shrink_policy);
+        conn->SetBufferQuota(_quota);
+        conn->SetEdgeTriggered(_edge_triggered);
+        if (_sock_busy_poll_us > 0 && !conn->SetBusyPoll(_sock_busy_poll_us)) {
+            DBG_LOG("SET SO_BUSY_POLL FAILED:%s", strerror(errno));
+        }
         if (_enable_inactive_release) conn->EnableInactiveRelease(_timeout);//启动非活跃超时销毁
+        return conn;
+    }
+    //baseloop上获取的新连接，交给选出的EventLoop线程构造和管理
+    void NewConnection(int fd) {
+        uint64_t id = ++_next_id;
+        EventLoop *loop = _pool.NextLoop(fd);
+        LoopContext *ctx = _loop_contexts.at(loop);
+        //还没有构造的连接先计入连接数，连接风暴时负载均衡也能看到已经分配出去的连接
+        loop->Stats().connections.fetch_add(1, std::memory_order_relaxed);
+        loop->RunInLoop([this, ctx, id, fd] {
+            ctx->loop->Stats().connections.fetch_sub(1, std::memory_order_relaxed);
+            NewConnectionInLoop(ctx, id, fd);
+        });
+    }
+    //在所属线程中构造Connection，由这个线程管理，移除时也不需要跨线程
+    void NewConnectionInLoop(LoopContext *ctx, uint64_t id, int fd) {
+        PtrConnection conn = CreateConnection(ctx->loop, id, fd);
+        conn->SetSrvClosedCallback([ctx](const PtrConnection &c) { ctx->conns.erase(c->Id()); });
         conn->Established();//就绪初始化
-        _conns.insert(std::make_pair(_next_id, conn));
+        ctx->conns.insert(std::make_pair(id, conn));
+    }
+    //SO_REUSEPORT模式下在从属线程上获取的新连接，已经在所属线程中
+    void NewLocalConnection(LoopContext *ctx, int fd) {
+        NewConnectionInLoop(ctx, ++_next_id, fd);
     }
-    void RemoveConnectionInLoop(const PtrConnection &conn) {
-        int id = conn->Id();
-        auto it = _conns.find(id);
-        if (it != _conns.end()) {
-            _conns.erase(it);
+    void CreateLoopContexts() {
+        for (auto loop : _pool.AllLoops()) {
+            auto ctx = std::make_unique<LoopContext>();
+            ctx->loop = loop;
+            _loop_contexts[loop] = ctx.get();
+            _contexts.push_back(std::move(ctx));
         }
     }
-    //从管理Connection的_conns中移除连接信息
-    void RemoveConnection(const PtrConnection &conn) {
-        _baseloop.RunInLoop([this, conn] { RemoveConnectionInLoop(conn); });
+    //每个从属线程创建自己的监听套接字，然后关闭baseloop上只绑定了地址、从来没有监听过的套接字
+    //baseloop的套接字如果监听过，关闭时会重置已经在它的监听队列里的连接
+    void CreateLocalAcceptors() {
+        for (auto &ctx : _contexts) {
+            EventLoop *loop = ctx->loop;
+            ctx->acceptor = std::make_unique<Acceptor>(loop, _port);
+            ctx->acceptor->SetEdgeTriggered(_edge_triggered);
+            ctx->acceptor->SetAcceptBatch(_accept_batch);
+            LoopContext *ptr = ctx.get();
+            ctx->acceptor->SetAcceptCallback([this, ptr](int fd) { NewLocalConnection(ptr, fd); });
+            //监听套接字的事件监控只能在所属线程中添加
+            loop->RunInLoop([ptr] { ptr->acceptor->Listen(); });
+        }
+        _acceptor.Close();
     }
 public:
-    explicit TcpServer(int port):
+    //type指定所有EventLoop的事件监控方式，io_uring不可用时自动退回epoll；timer指定所有EventLoop的定时器实现
+    explicit TcpServer(int port, PollerType type = PollerType::EPOLL, TimerType timer = TimerType::WHEEL):
             _port(port),
             _next_id(0),
             _enable_inactive_release(false),
+            _in_buffer_mode(BufferMode::CONTIGUOUS),
+            _pool_high_watermark(POOL_HIGH_WATERMARK),
+            _pool_low_watermark(POOL_LOW_WATERMARK),
+            _high_water_mark(CONN_HIGH_WATER_MARK),
+            _pause_read_on_high_water(false),
+            _edge_triggered(false),
+            _reuse_port(false),
+            _accept_batch(ACCEPT_BATCH),
+            _busy_poll_us(0),
+            _sock_busy_poll_us(0),
+            _coarse_clock(false),
+            _baseloop(type, timer),
             _acceptor(&_baseloop, port),
-            _pool(&_baseloop) {
+            _pool(&_baseloop, type, timer) {
         _acceptor.SetAcceptCallback([this](auto && PH1) { NewConnection(PH1); });
-        _acceptor.Listen();//将监听套接字挂到baseloop上
     }
     void SetThreadCount(int count) { return _pool.SetThreadCount(count); }
+    //设置新连接分配到从属EventLoop的策略，SO_REUSEPORT模式下由内核分配，不起作用
+    void SetLoopBalance(LoopBalance balance) { _pool.SetBalance(balance); }
+    void SetLoopBalance(const LoopThreadPool::BalanceFunc &func) { _pool.SetBalance(func); }
+    //设置EventLoop线程的CPU绑定方案，Start之前调用
+    void SetLoopAffinity(const LoopAffinity &affinity) { _pool.SetAffinity(affinity); }
     void SetConnectedCallback(const ConnectedCallback&cb) { _connected_callback = cb; }
     void SetMessageCallback(const MessageCallback&cb) { _message_callback = cb; }
     void SetClosedCallback(const ClosedCallback&cb) { _closed_callback = cb; }
     void SetAnyEventCallback(const AnyEventCallback&cb) { _event_callback = cb; }
-    void EnableInactiveRelease(int timeout) { _timeout = timeout; _enable_inactive_release = true; }
-    //用于添加一个定时任务
-    void RunAfter(const Functor &task, int delay) {
-        _baseloop.RunInLoop([this, task, delay] { RunAfterInLoop(task, delay); });
+    void SetHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t mark) {
+        _high_water_mark_callback = cb;
+        _high_water_mark = mark;
+    }
+    void SetWriteCompleteCallback(const WriteCompleteCallback &cb) { _write_complete_callback = cb; }
+    //连接输出缓冲区超过高水位时自动暂停读取，对端跟上后恢复
+    void SetPauseReadOnHighWater(bool on) { _pause_read_on_high_water = on; }
+    //使用边缘触发模式：accept和连接的读写都一直处理到EAGAIN，减少epoll_wait的次数，Start之前调用
+    void SetEdgeTriggered(bool on) {
+        _edge_triggered = on;
+        _acceptor.SetEdgeTriggered(on);
+    }
+    //一次可读事件最多获取的新连接个数
+    void SetAcceptBatch(int n) {
+        _accept_batch = n;
+        _acceptor.SetAcceptBatch(n);
+    }
+    //每个从属线程各自创建SO_REUSEPORT监听套接字，由内核分配新连接，在本线程accept和管理，Start之前调用
+    //没有从属线程时不起作用
+    void SetReusePort(bool on) { _reuse_port = on; }
+    //延迟敏感的场景：EventLoop没有事件时先自旋spin_us微秒再阻塞，sock_us大于0时给新连接设置SO_BUSY_POLL
+    //自旋会占满EventLoop所在的CPU，Start之前调用
+    void SetBusyPoll(uint32_t spin_us, int sock_us = 0) {
+        _busy_poll_us = spin_us;
+        _sock_busy_poll_us = sock_us;
+    }
+    //EventLoop每一轮缓存时间时使用CLOCK_*_COARSE，日志、Date头和空闲判断的精度降到一个内核节拍，Start之前调用
+    void SetCoarseClock(bool on) { _coarse_clock = on; }
+    void EnableInactiveRelease(TimerDuration timeout) { _timeout = timeout; _enable_inactive_release = true; }
+    //设置新连接输入缓冲区的模式，链式模式下直接readv接收，但是协议解析需要连续数据时会触发合并
+    void SetInBufferMode(BufferMode mode) { _in_buffer_mode = mode; }
+    //设置连接缓冲区的收缩策略
+    void SetBufferShrinkPolicy(const BufferShrinkPolicy &policy) { _shrink_policy = policy; }
+    //限制所有连接缓冲数据的总量，达到high后连接暂停读取，降到low以下恢复，Start之前调用
+    void SetBufferLimit(uint64_t high, uint64_t low) { _quota = std::make_shared<BufferQuota>(high, low); }
+    //当前所有连接缓冲的数据总量，没有设置上限时返回0
+    uint64_t BufferedBytes() { return _quota ? _quota->Used() : 0; }
+    //设置各个EventLoop内存池的高低水位，Start之前调用
+    void SetPoolWatermark(uint64_t high, uint64_t low) { _pool_high_watermark = high; _pool_low_watermark = low; }
+    //baseloop以及线程池中的所有EventLoop，用于读取各个EventLoop的统计信息
+    std::vector<EventLoop *> Loops() {
+        std::vector<EventLoop *> loops{&_baseloop};
+        for (auto loop : _pool.AllLoops()) {
+            if (loop != &_baseloop) loops.push_back(loop);
+        }
+        return loops;
+    }
+    //所有EventLoop内存池的统计信息
+    std::vector<PoolStats> GetPoolStats() {
+        std::vector<PoolStats> stats;
+        for (auto loop : Loops()) stats.push_back(loop->GetPoolStats());
+        return stats;
+    }
+    //在baseloop中执行的定时任务，参数和EventLoop的同名接口一致：先是时间，再是回调
+    //定时任务的ID由定时器分配，不再占用连接ID
+    TimerId RunAt(std::chrono::steady_clock::time_point when, const Functor &task) {
+        return _baseloop.RunAt(when, task);
+    }
+    TimerId RunAfter(TimerDuration delay, const Functor &task) {
+        return _baseloop.RunAfter(delay, task);
+    }
+    TimerId RunEvery(TimerDuration interval, const Functor &task) {
+        return _baseloop.RunEvery(interval, task);
+    }
+    void CancelTimer(TimerId timer) { _baseloop.Cancel(timer); }
+    void Start() {
+        _pool.Create();
+        CreateLoopContexts();
+        //Start之后才开始监听，SO_REUSEPORT模式下baseloop的套接字不监听
+        if (_reuse_port && _pool.AllLoops().front() != &_baseloop) CreateLocalAcceptors();
+        else _acceptor.Listen();//将监听套接字挂到baseloop上
+        for (auto loop : Loops()) {
+            loop->SetPoolWatermark(_pool_high_watermark, _pool_low_watermark);
+            loop->SetBusyPoll(_busy_poll_us);
+            loop->SetCoarseClock(_coarse_clock);
+        }
+        _baseloop.Start();
     }
-    void Start() { _pool.Create();  _baseloop.Start(); }
 };
 
 class NetWork {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "EventLoop.hpp"
+#include "Affinity.hpp"
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -11,11 +12,17 @@ private:
     std::mutex _mutex;          
     std::condition_variable _cond;   
     EventLoop *_loop;       
+    PollerType _poller_type;    //线程中EventLoop的事件监控方式
+    TimerType _timer_type;      //线程中EventLoop的定时器实现
+    int _cpu;                   //线程绑定的CPU，-1表示不绑定
+    bool _numa_local;           //是否优先从CPU所在的NUMA节点申请内存
     std::thread _thread;    
 private:
     /*实例化 EventLoop 对象，唤醒_cond上有可能阻塞的线程，并且开始运行EventLoop模块的功能*/
     void ThreadEntry() {
-        EventLoop loop;
+        //先绑定CPU再创建EventLoop，内存池和缓冲区在绑定之后由本线程申请，落在本地NUMA节点上
+        Affinity::Apply(_cpu, _numa_local);
+        EventLoop loop(_poller_type, _timer_type);
         {
             std::unique_lock<std::mutex> lock(_mutex);
             _loop = &loop;
@@ -25,7 +32,10 @@ private:
     }
 public:
     /*创建线程，设定线程入口函数*/
-    LoopThread():_loop(nullptr), _thread(std::thread(&LoopThread::ThreadEntry, this)) {}
+    explicit LoopThread(PollerType type = PollerType::EPOLL, int cpu = -1, bool numa_local = false,
+                        TimerType timer = TimerType::WHEEL):
+            _loop(nullptr), _poller_type(type), _timer_type(timer), _cpu(cpu), _numa_local(numa_local),
+            _thread(std::thread(&LoopThread::ThreadEntry, this)) {}
     /*返回当前线程关联的EventLoop对象指针*/
     EventLoop *GetLoop() {
         EventLoop *loop = nullptr;
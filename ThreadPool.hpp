@@ -1,32 +1,183 @@
 #pragma once
 
 #include "Thread.hpp"
+#include "Affinity.hpp"
+#include <random>
+#include <functional>
+#include <algorithm>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define POOL_HASH_VNODES 128    //一致性哈希环上每个EventLoop的虚拟节点数
+
+//新连接分配EventLoop的策略
+enum class LoopBalance {
+    ROUND_ROBIN,            //轮询
+    LEAST_CONNECTIONS,      //连接数最少
+    LEAST_PENDING_BYTES,    //缓冲数据最少
+    POWER_OF_TWO,           //随机选两个，取连接数少的
+    IP_HASH,                //按客户端IP一致性哈希，同一个IP总是分配到同一个EventLoop
+    INCOMING_CPU            //分配到绑定在处理这个连接网卡接收队列的CPU上的EventLoop，需要绑定CPU，找不到时退化为轮询
+};
 
 class LoopThreadPool {
+public:
+    //自定义分配策略：参数是所有从属EventLoop和新连接的描述符，返回选中的EventLoop
+    using BalanceFunc = std::function<EventLoop *(const std::vector<EventLoop *> &, int)>;
 private:
     int _thread_count;
     int _next_idx;
     EventLoop *_baseloop;
     std::vector<LoopThread*> _threads;
     std::vector<EventLoop *> _loops;
+    LoopBalance _balance;
+    PollerType _poller_type;        //从属EventLoop的事件监控方式
+    TimerType _timer_type;          //从属EventLoop的定时器实现
+    LoopAffinity _affinity;         //CPU绑定方案
+    std::vector<int> _cpu_loops;    //CPU -> 绑定在这个CPU上的第一个_loops下标，-1表示没有
+    BalanceFunc _balance_func;
+    std::minstd_rand _rand;
+    std::vector<std::pair<uint32_t, int>> _ring;    //一致性哈希环：虚拟节点的哈希值 -> _loops下标
+private:
+    static uint32_t Mix(uint32_t h) {
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+    static uint32_t Hash(const void *data, size_t len) {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < len; i++) {
+            h ^= p[i];
+            h *= 16777619u;
+        }
+        return Mix(h);
+    }
+    void BuildRing() {
+        _ring.clear();
+        for (int i = 0; i < _thread_count; i++) {
+            for (uint32_t v = 0; v < POOL_HASH_VNODES; v++) {
+                uint32_t key[2] = {(uint32_t)i, v};
+                _ring.emplace_back(Hash(key, sizeof(key)), i);
+            }
+        }
+        std::sort(_ring.begin(), _ring.end());
+    }
+    //按指定的负载指标选择最小的，指标相同时选连接数少的
+    EventLoop *LeastBy(std::atomic<int64_t> LoopStats::*metric) {
+        EventLoop *best = nullptr;
+        std::pair<int64_t, int64_t> min;
+        for (auto loop : _loops) {
+            std::pair<int64_t, int64_t> val((loop->Stats().*metric).load(std::memory_order_relaxed),
+                                            loop->Stats().connections.load(std::memory_order_relaxed));
+            if (best == nullptr || val < min) {
+                min = val;
+                best = loop;
+            }
+        }
+        return best;
+    }
+    EventLoop *PowerOfTwo() {
+        if (_thread_count == 1) return _loops[0];
+        int a = _rand() % _thread_count;
+        int b = _rand() % (_thread_count - 1);
+        if (b >= a) b++;
+        int64_t ca = _loops[a]->Stats().connections.load(std::memory_order_relaxed);
+        int64_t cb = _loops[b]->Stats().connections.load(std::memory_order_relaxed);
+        return ca <= cb ? _loops[a] : _loops[b];
+    }
+    //按对端IP在哈希环上顺时针找第一个虚拟节点，取不到对端地址时退化为轮询
+    EventLoop *IpHash(int fd) {
+        struct sockaddr_storage addr{};
+        socklen_t len = sizeof(addr);
+        if (fd < 0 || getpeername(fd, (struct sockaddr *)&addr, &len) < 0) return RoundRobin();
+        uint32_t h;
+        if (addr.ss_family == AF_INET) {
+            auto *in = (struct sockaddr_in *)&addr;
+            h = Hash(&in->sin_addr, sizeof(in->sin_addr));
+        }else if (addr.ss_family == AF_INET6) {
+            auto *in6 = (struct sockaddr_in6 *)&addr;
+            h = Hash(&in6->sin6_addr, sizeof(in6->sin6_addr));
+        }else {
+            return RoundRobin();
+        }
+        auto it = std::lower_bound(_ring.begin(), _ring.end(), std::make_pair(h, 0));
+        if (it == _ring.end()) it = _ring.begin();
+        return _loops[it->second];
+    }
+    //内核记录的处理这个连接接收数据的CPU，在那个CPU上处理连接，缓存和中断都在同一个核上
+    EventLoop *IncomingCpu(int fd) {
+        int cpu = -1;
+        socklen_t len = sizeof(cpu);
+        if (fd < 0 || getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0) return RoundRobin();
+        if (cpu < 0 || (size_t)cpu >= _cpu_loops.size() || _cpu_loops[cpu] < 0) return RoundRobin();
+        return _loops[_cpu_loops[cpu]];
+    }
+    //从属EventLoop依次使用的CPU，没有启用绑定时为空；必须在绑定baseloop之前调用
+    //自动分配时PlanLoopCpus已经去掉了baseloop的CPU(只有一个CPU时除外)
+    std::vector<int> LoopCpus() {
+        return Affinity::PlanLoopCpus(_affinity, Affinity::AllowedCpus());
+    }
+    EventLoop *RoundRobin() {
+        _next_idx = (_next_idx + 1) % _thread_count;
+        return _loops[_next_idx];
+    }
 public:
-    explicit LoopThreadPool(EventLoop *baseloop):_thread_count(0), _next_idx(0), _baseloop(baseloop) {}
+    explicit LoopThreadPool(EventLoop *baseloop, PollerType type = PollerType::EPOLL,
+                            TimerType timer = TimerType::WHEEL):
+            _thread_count(0), _next_idx(0), _baseloop(baseloop),
+            _balance(LoopBalance::ROUND_ROBIN), _poller_type(type), _timer_type(timer), _rand(std::random_device{}()) {}
     void SetThreadCount(int count) { _thread_count = count; }
+    //设置新连接的分配策略，Create之前调用
+    void SetBalance(LoopBalance balance) { _balance = balance; }
+    //设置自定义的分配策略，优先于SetBalance
+    void SetBalance(const BalanceFunc &func) { _balance_func = func; }
+    //设置CPU绑定方案，Create之前调用
+    void SetAffinity(const LoopAffinity &affinity) { _affinity = affinity; }
+    //在baseloop线程中调用
     void Create() {
+        //先按进程允许的CPU分配好从属EventLoop的CPU，再绑定baseloop
+        std::vector<int> cpus = _thread_count > 0 ? LoopCpus() : std::vector<int>();
+        if (_affinity.enable && _affinity.base_cpu >= 0) {
+            Affinity::Apply(_affinity.base_cpu, _affinity.numa_local);
+        }
         if (_thread_count > 0) {
             _threads.resize(_thread_count);
             _loops.resize(_thread_count);
             for (int i = 0; i < _thread_count; i++) {
-                _threads[i] = new LoopThread();
+                int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+                _threads[i] = new LoopThread(_poller_type, cpu, _affinity.numa_local, _timer_type);
                 _loops[i] = _threads[i]->GetLoop();
+                if (cpu < 0) continue;
+                if ((size_t)cpu >= _cpu_loops.size()) _cpu_loops.resize(cpu + 1, -1);
+                if (_cpu_loops[cpu] < 0) _cpu_loops[cpu] = i;
             }
+            BuildRing();
+        }
+    }
+    //包括baseloop在内的所有EventLoop
+    std::vector<EventLoop *> AllLoops() {
+        if (_thread_count == 0) {
+            return {_baseloop};
         }
+        return _loops;
     }
-    EventLoop *NextLoop() {
+    //为描述符fd上的新连接选择一个EventLoop
+    EventLoop *NextLoop(int fd = -1) {
         if (_thread_count == 0) {
             return _baseloop;
         }
-        _next_idx = (_next_idx + 1) % _thread_count;
-        return _loops[_next_idx];
+        if (_balance_func) return _balance_func(_loops, fd);
+        switch (_balance) {
+            case LoopBalance::LEAST_CONNECTIONS: return LeastBy(&LoopStats::connections);
+            case LoopBalance::LEAST_PENDING_BYTES: return LeastBy(&LoopStats::pending_bytes);
+            case LoopBalance::POWER_OF_TWO: return PowerOfTwo();
+            case LoopBalance::IP_HASH: return IpHash(fd);
+            case LoopBalance::INCOMING_CPU: return IncomingCpu(fd);
+            default: return RoundRobin();
+        }
     }
-};
\ No newline at end of file
+};
@@ -1,125 +1,113 @@
 #pragma once
 
 
-#include "Timer.hpp"
-#include "EventLoop.hpp"
-#include <sys/timerfd.h>
-#include <memory>
-
-
-class TimerWheel {
+#include "TimerQueue.hpp"
+#include <bit>
+
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)     //每一层的槽位数
+#define TIMER_SLOT_MASK (TIMER_SLOTS - 1)
+#define TIMER_LEVELS 6                          //层数，一个刻度1毫秒，最多2^36毫秒(约795天)
+
+//多层时间轮，刻度为1毫秒
+//第k层的一个槽位覆盖64^k个刻度，到期时间距离当前刻度小于64^(k+1)的任务放在第k层
+//第0层的槽位到期时直接执行，高层的槽位在当前刻度走到它覆盖的范围起点时整体下放到低层
+//timerfd只在下一个非空槽位(到期或者下放)的时间唤醒
+class TimerWheel : public TimerQueue {
 private:
-    using WeakTask = std::weak_ptr<TimerTask>;
-    using PtrTask = std::shared_ptr<TimerTask>;
-    uint64_t _tick;
-    int _capacity;  
-    std::vector<std::vector<PtrTask>> _wheel;
-    std::unordered_map<uint64_t, WeakTask> _timers;
-
-    EventLoop *_loop;
-    int _timerfd;
-    std::unique_ptr<Channel> _timer_channel;
+    uint64_t _now;      //下一个要处理的刻度，之前的刻度都已经处理过
+    TimerLink _slots[TIMER_LEVELS][TIMER_SLOTS];
+    uint64_t _bitmap[TIMER_LEVELS];     //每一层非空槽位的位图
 private:
-    void RemoveTimer(uint64_t id) {
-        auto it = _timers.find(id);
-        if (it != _timers.end()) {
-            _timers.erase(it);
-        }
+    //按到期时间放进对应的层和槽位，返回需要为它唤醒的刻度：第0层是到期时间，高层是下放时间
+    uint64_t Insert(TimerTask *task) override {
+        uint64_t expire = std::max(task->Expire(), _now);
+        uint64_t diff = expire - _now;
+        int level = 0;
+        while (level < TIMER_LEVELS - 1 && diff >> (TIMER_SLOT_BITS * (level + 1))) level++;
+        if (diff >> (TIMER_SLOT_BITS * TIMER_LEVELS)) expire = _now + (1ULL << (TIMER_SLOT_BITS * TIMER_LEVELS)) - 1;
+        int shift = TIMER_SLOT_BITS * level;
+        int slot = (expire >> shift) & TIMER_SLOT_MASK;
+        task->SetExpire(expire);
+        task->SetPosition(level, slot);
+        _slots[level][slot].PushBack(task);
+        _bitmap[level] |= 1ULL << slot;
+        return (expire >> shift) << shift;
     }
-
-    static int CreateTimerfd() {
-        int timerfd = timerfd_create(CLOCK_MONOTONIC, 0);
-        if (timerfd < 0) {
-            ERR_LOG("TIMERFD CREATE FAILED!");
-            abort();
+    void Remove(TimerTask *task) override {
+        task->Unlink();
+        if (_slots[task->Level()][task->Slot()].Empty()) {
+            _bitmap[task->Level()] &= ~(1ULL << task->Slot());
         }
-        
-        struct itimerspec itime{};
-        itime.it_value.tv_sec = 1;
-        itime.it_value.tv_nsec = 0;
-        itime.it_interval.tv_sec = 1;
-        itime.it_interval.tv_nsec = 0; 
-        timerfd_settime(timerfd, 0, &itime, nullptr);
-        return timerfd;
     }
-
-    uint64_t ReadTimefd() const {
-        uint64_t times;
-        
-        
-        ssize_t ret = read(_timerfd, &times, 8);
-        if (ret < 0) {
-            ERR_LOG("READ TIMEFD FAILED!");
-            abort();
+    //第level层的slot槽位整体下放，里面任务的到期时间都在这一层槽位覆盖的范围内，会落到更低的层
+    void Cascade(int level, int slot) {
+        TimerLink list;
+        _slots[level][slot].MoveTo(list);
+        _bitmap[level] &= ~(1ULL << slot);
+        while (!list.Empty()) {
+            TimerTask *task = static_cast<TimerTask *>(list.next);
+            task->Unlink();
+            Insert(task);
         }
-        return times;
-    }
-
-    
-    void RunTimerTask() {
-        _tick = (_tick + 1) % _capacity;
-        _wheel[_tick].clear();
     }
-
-    void OnTime() {
-        
-        uint64_t times = ReadTimefd();
-        for (int i = 0; i < times; i++) {
-            RunTimerTask();
+    //处理刻度_now：先下放到达范围起点的高层槽位，再执行第0层当前槽位的任务
+    void Tick() {
+        uint64_t tick = _now;
+        for (int level = 1; level < TIMER_LEVELS; level++) {
+            int shift = TIMER_SLOT_BITS * level;
+            if (tick & ((1ULL << shift) - 1)) break;
+            Cascade(level, (tick >> shift) & TIMER_SLOT_MASK);
+        }
+        int slot = tick & TIMER_SLOT_MASK;
+        TimerLink expired;
+        _slots[0][slot].MoveTo(expired);
+        _bitmap[0] &= ~(1ULL << slot);
+        _now = tick + 1;
+        while (!expired.Empty()) {
+            TimerTask *task = static_cast<TimerTask *>(expired.next);
+            task->Unlink();
+            Expire(task, tick);
         }
     }
-
-    void TimerAddInLoop(uint64_t id, uint32_t delay, const TaskFunc &cb) {
-        PtrTask pt(new TimerTask(id, delay, cb));
-        pt->SetRelease([this, id] { RemoveTimer(id); });
-        uint64_t pos = (_tick + delay) % _capacity;
-        _wheel[pos].push_back(pt);
-        _timers[id] = WeakTask(pt);
-    }
-
-    void TimerRefreshInLoop(uint64_t id) {
-        
-        auto it = _timers.find(id);
-        if (it == _timers.end()) {
-            return;
+    //处理到刻度until为止(包括until)，只处理有任务到期或者需要下放的刻度，中间的空刻度直接跳过
+    //跳过的刻度上需要下放的槽位都是空的，已有任务的位置相对新的_now仍然正确
+    void Advance(uint64_t until) override {
+        while (true) {
+            uint64_t next = NextWakeup();
+            if (next > until) break;
+            _now = next;
+            Tick();
         }
-        PtrTask pt = it->second.lock();
-        uint64_t delay = pt->DelayTime();
-        uint64_t pos = (_tick + delay) % _capacity;
-        _wheel[pos].push_back(pt);
+        _now = std::max(_now, until + 1);
     }
-
-    void TimerCancelInLoop(uint64_t id) {
-        auto it = _timers.find(id);
-        if (it == _timers.end()) {
-            return;
+    //下一个需要处理的刻度：第0层最近的非空槽位，或者高层最近一个非空槽位的下放时间
+    uint64_t NextWakeup() const override {
+        uint64_t idx = _now & TIMER_SLOT_MASK;
+        uint64_t best = TIMER_NEVER;
+        if (_bitmap[0]) {
+            //_now正好在槽位边界上时高层可能有同一时刻需要下放的槽位，不能直接返回，和高层一起比较
+            uint64_t pending = _bitmap[0] >> idx;
+            if (pending) best = _now + std::countr_zero(pending);
+            //当前一圈剩下的槽位都空了，其余的任务在下一圈
+            else best = (_now | TIMER_SLOT_MASK) + 1 + std::countr_zero(_bitmap[0]);
+        }
+        for (int level = 1; level < TIMER_LEVELS; level++) {
+            if (!_bitmap[level]) continue;
+            int shift = TIMER_SLOT_BITS * level;
+            //从_now之后第一个槽位边界开始，找第一个非空槽位
+            uint64_t first = (_now + (1ULL << shift) - 1) >> shift;
+            uint64_t rotated = std::rotr(_bitmap[level], (int)(first & TIMER_SLOT_MASK));
+            best = std::min(best, (first + std::countr_zero(rotated)) << shift);
         }
-        PtrTask pt = it->second.lock();
-        if (pt) pt->Cancel();
+        return best;
     }
-
+    bool Queued(const TimerTask *task) const override { return !task->Empty(); }
 public:
-    explicit TimerWheel(EventLoop *loop) : _capacity(60), _tick(0), _wheel(_capacity), _loop(loop),
-                                  _timerfd(CreateTimerfd()),
-                                  _timer_channel(std::make_unique<Channel>(_loop, _timerfd)) {
-        _timer_channel->SetReadCallback([this] { OnTime(); });
-        _timer_channel->EnableRead();
+    explicit TimerWheel(EventLoop *loop) : TimerQueue(loop), _now(NowMs()), _bitmap{} {}
+    ~TimerWheel() override {
+        for (auto &it : _timers) it.second->Unlink();
     }
-    /*定时器中有个_timers成员，定时器信息的操作有可能在多线程中进行，因此需要考虑线程安全问题*/
-    /*如果不想加锁，那就把对定期的所有操作，都放到一个线程中进行*/
-    void TimerAdd(uint64_t id, uint32_t delay, const TaskFunc &cb);
-
-    
-    void TimerRefresh(uint64_t id);
-
-    void TimerCancel(uint64_t id);
+    const char *Name() const override { return "wheel"; }
+};
 
-    /*这个接口存在线程安全问题--这个接口实际上不能被外界使用者调用，只能在模块内，在对应的EventLoop线程内执行*/
-    bool HasTimer(uint64_t id) {
-        auto it = _timers.find(id);
-        if (it == _timers.end()) {
-            return false;
-        }
-        return true;
-    }
-};
\ No newline at end of file
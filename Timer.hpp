@@ -1,28 +1,81 @@
 #pragma once
 
-#include <iostream>
-#include <functional>
+#include <cstdint>
 #include <utility>
+#include <chrono>
+#include "Function.hpp"
 
 
-using TaskFunc = std::function<void()>;
-using ReleaseFunc = std::function<void()>;
+using TaskFunc = UniqueFunction<void()>;
+//定时接口的时长，std::chrono的各种时长都可以直接传入，定时器按毫秒向上取整
+using TimerDuration = std::chrono::steady_clock::duration;
 
-class TimerTask{
+//RunAt/RunAfter/RunEvery返回的定时任务句柄，只用来取消，ID由时间轮分配，不会和使用者自己指定的ID冲突
+class TimerId {
 private:
-    uint64_t _id;       
-    uint32_t _timeout;  
-    bool _canceled;     
-    TaskFunc _task_cb;  
-    ReleaseFunc _release; 
+    uint64_t _id;
 public:
-    TimerTask(uint64_t id, uint32_t delay, TaskFunc cb):
-            _id(id), _timeout(delay), _task_cb(std::move(cb)), _canceled(false) {}
-    ~TimerTask() {
-        if (!_canceled) _task_cb();
-        _release();
+    TimerId():_id(0) {}
+    explicit TimerId(uint64_t id):_id(id) {}
+    uint64_t Id() const { return _id; }
+    bool Valid() const { return _id != 0; }
+};
+
+//定时任务链表的链接部分，时间轮的每个槽位是一个带哨兵的双向循环链表，插入和删除都是O(1)
+struct TimerLink {
+    TimerLink *prev;
+    TimerLink *next;
+    TimerLink():prev(this), next(this) {}
+    TimerLink(const TimerLink &) = delete;
+    TimerLink &operator=(const TimerLink &) = delete;
+    bool Empty() const { return next == this; }
+    void PushBack(TimerLink *node) {
+        node->prev = prev;
+        node->next = this;
+        prev->next = node;
+        prev = node;
+    }
+    void Unlink() {
+        prev->next = next;
+        next->prev = prev;
+        prev = next = this;
+    }
+    //把整条链表转移到空链表dst上
+    void MoveTo(TimerLink &dst) {
+        if (Empty()) return;
+        dst.next = next;
+        dst.prev = prev;
+        next->prev = &dst;
+        prev->next = &dst;
+        prev = next = this;
     }
-    void Cancel() { _canceled = true; }
-    void SetRelease(const ReleaseFunc &cb) { _release = cb; }
+};
+
+class TimerTask : public TimerLink {
+private:
+    uint64_t _id;
+    uint32_t _timeout;  //延迟时间，毫秒，刷新时按这个时间重新计算到期时间
+    uint32_t _index;    //最小堆定时器中的下标，不在堆中时为UINT32_MAX；时间轮使用链表和下面的层、槽位
+    uint64_t _expire;   //到期时间，CLOCK_MONOTONIC毫秒
+    uint8_t _level;     //所在的时间轮层和槽位，删除后用来判断槽位是否变空
+    uint8_t _slot;
+    bool _repeat;       //周期任务，每次执行之后按_timeout重新放入
+    const uint64_t *_active_stamp;  //空闲超时任务：最近活跃时间，到期时从这个时间重新计算，为空表示普通定时任务
+    TaskFunc _task_cb;
+public:
+    TimerTask(uint64_t id, uint32_t delay, TaskFunc cb, const uint64_t *active_stamp = nullptr, bool repeat = false):
+            _id(id), _timeout(delay), _index(UINT32_MAX), _expire(0), _level(0), _slot(0), _repeat(repeat),
+            _active_stamp(active_stamp), _task_cb(std::move(cb)) {}
+    void Run() { _task_cb(); }
+    uint64_t Id() const { return _id; }
     uint32_t DelayTime() const { return _timeout; }
-};
\ No newline at end of file
+    uint64_t Expire() const { return _expire; }
+    const uint64_t *ActiveStamp() const { return _active_stamp; }
+    bool Repeat() const { return _repeat; }
+    void SetExpire(uint64_t expire) { _expire = expire; }
+    int Level() const { return _level; }
+    int Slot() const { return _slot; }
+    void SetPosition(int level, int slot) { _level = (uint8_t)level; _slot = (uint8_t)slot; }
+    uint32_t Index() const { return _index; }
+    void SetIndex(uint32_t index) { _index = index; }
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "TimerQueue.hpp"
+#include <vector>
+
+#define TIMER_HEAP_ARITY 4      //每个节点的子节点数，四叉堆比二叉堆层数少一半，一个节点的子节点在同一条缓存行附近
+
+//四叉最小堆定时器，按到期时间精确排序，timerfd总是设置为堆顶任务的到期时间
+//每个任务记录自己在堆中的下标，取消和刷新时直接从所在位置调整，O(log n)
+//和时间轮相比没有下放的开销，到期时间任意远也不会被截断，适合数量不多、要求准时的定时任务
+class TimerHeap : public TimerQueue {
+private:
+    uint64_t _now;      //下一个要处理的时间，之前的时间都已经处理过
+    std::vector<TimerTask *> _heap;
+private:
+    void Place(uint32_t idx, TimerTask *task) {
+        _heap[idx] = task;
+        task->SetIndex(idx);
+    }
+    void SiftUp(uint32_t idx) {
+        TimerTask *task = _heap[idx];
+        while (idx > 0) {
+            uint32_t parent = (idx - 1) / TIMER_HEAP_ARITY;
+            if (_heap[parent]->Expire() <= task->Expire()) break;
+            Place(idx, _heap[parent]);
+            idx = parent;
+        }
+        Place(idx, task);
+    }
+    void SiftDown(uint32_t idx) {
+        TimerTask *task = _heap[idx];
+        uint32_t size = _heap.size();
+        while (true) {
+            uint32_t first = idx * TIMER_HEAP_ARITY + 1;
+            if (first >= size) break;
+            uint32_t last = std::min(first + TIMER_HEAP_ARITY, size);
+            uint32_t child = first;
+            for (uint32_t i = first + 1; i < last; i++) {
+                if (_heap[i]->Expire() < _heap[child]->Expire()) child = i;
+            }
+            if (task->Expire() <= _heap[child]->Expire()) break;
+            Place(idx, _heap[child]);
+            idx = child;
+        }
+        Place(idx, task);
+    }
+    //已经处理过的时间上添加的任务放到下一次处理，任务中反复添加0延迟的任务不会让一次处理停不下来
+    uint64_t Insert(TimerTask *task) override {
+        task->SetExpire(std::max(task->Expire(), _now));
+        _heap.push_back(task);
+        SiftUp(_heap.size() - 1);
+        return task->Expire();
+    }
+    //用最后一个任务填补空位，再按它的到期时间向上或者向下调整
+    void Remove(TimerTask *task) override {
+        uint32_t idx = task->Index();
+        if (idx == UINT32_MAX) return ;
+        task->SetIndex(UINT32_MAX);
+        TimerTask *last = _heap.back();
+        _heap.pop_back();
+        if (last == task) return ;
+        Place(idx, last);
+        if (idx > 0 && _heap[(idx - 1) / TIMER_HEAP_ARITY]->Expire() > last->Expire()) SiftUp(idx);
+        else SiftDown(idx);
+    }
+    bool Queued(const TimerTask *task) const override { return task->Index() != UINT32_MAX; }
+    void Advance(uint64_t until) override {
+        _now = std::max(_now, until + 1);
+        while (!_heap.empty() && _heap.front()->Expire() <= until) {
+            TimerTask *task = _heap.front();
+            Remove(task);
+            Expire(task, until);
+        }
+    }
+    uint64_t NextWakeup() const override {
+        return _heap.empty() ? TIMER_NEVER : _heap.front()->Expire();
+    }
+public:
+    explicit TimerHeap(EventLoop *loop) : TimerQueue(loop), _now(NowMs()) {}
+    const char *Name() const override { return "heap"; }
+};
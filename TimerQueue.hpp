@@ -0,0 +1,218 @@
+#pragma once
+
+#include "Timer.hpp"
+#include "Log.hpp"
+#include "Channel.hpp"
+#include "MemoryPool.hpp"
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <ctime>
+#include <cerrno>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+#define TIMER_NEVER UINT64_MAX
+#define TIMER_AUTO_ID (1ULL << 63)              //定时器分配的定时任务ID的标志位，连接ID和连接的定时任务ID都用不到这一位
+
+//定时器的实现方式
+enum class TimerType {
+    WHEEL,      //多层时间轮，添加删除O(1)，适合大量会被取消或者推迟的超时任务
+    HEAP,       //四叉最小堆，添加删除O(log n)，按到期时间精确排序，没有下放的开销
+};
+
+//定时器的公共部分：ID表、任务执行规则和timerfd，不同的实现只负责按到期时间组织任务
+//timerfd是绝对时间的单次定时，只设置为下一个需要处理的时间，没有定时任务时不会唤醒
+//空闲超时任务不需要在每次活动时刷新：使用者只更新最近活跃时间，到期时发现期间有过活动就按活跃时间原地重新放入
+class TimerQueue {
+protected:
+    uint64_t _armed;    //timerfd当前设置的唤醒时间
+    bool _ticking;      //正在处理到期任务，任务中添加定时器时不用设置timerfd，处理完统一设置
+    std::unordered_map<uint64_t, TimerTask *> _timers;
+    std::atomic<uint64_t> _auto_id;     //RunAt/RunAfter/RunEvery的ID，任意线程都可以申请
+    TimerTask *_running;                //正在执行的周期任务，执行期间被取消时由RunRepeat释放
+
+    EventLoop *_loop;
+    int _timerfd;
+    std::unique_ptr<Channel> _timer_channel;
+protected:
+    static uint64_t NowMs() {
+        struct timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+    static TimerTask *NewTask(uint64_t id, uint32_t delay, TaskFunc cb, const uint64_t *stamp, bool repeat) {
+        //定时任务对象从当前线程的内存池申请
+        void *ptr = MemoryPool::Local().Allocate(sizeof(TimerTask));
+        return ::new (ptr) TimerTask(id, delay, std::move(cb), stamp, repeat);
+    }
+    static void DeleteTask(TimerTask *task) {
+        task->~TimerTask();
+        MemoryPool::Local().Deallocate(task, sizeof(TimerTask));
+    }
+
+    static int CreateTimerfd() {
+        int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timerfd < 0) {
+            ERR_LOG("TIMERFD CREATE FAILED!");
+            abort();
+        }
+        return timerfd;
+    }
+
+    uint64_t ReadTimefd() const {
+        uint64_t times;
+        //处理到期事件之前有可能已经重新设置过timerfd，到期次数被清零，读不到数据
+        ssize_t ret = read(_timerfd, &times, 8);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EINTR) return 0;
+            ERR_LOG("READ TIMEFD FAILED!");
+            abort();
+        }
+        return times;
+    }
+    //设置timerfd在毫秒时间wake唤醒，绝对时间，已经过去的时间会立即唤醒
+    void Arm(uint64_t wake) {
+        if (wake == _armed) return;
+        _armed = wake;
+        struct itimerspec itime{};
+        if (wake != TIMER_NEVER) {
+            itime.it_value.tv_sec = wake / 1000;
+            itime.it_value.tv_nsec = (wake % 1000) * 1000000;
+        }
+        timerfd_settime(_timerfd, TFD_TIMER_ABSTIME, &itime, nullptr);
+    }
+    void ArmIfEarlier(uint64_t wake) {
+        if (!_ticking && wake < _armed) Arm(wake);
+    }
+
+    //放入任务，到期时间已经设置好，返回需要为它唤醒的时间
+    virtual uint64_t Insert(TimerTask *task) = 0;
+    //取出还没有到期的任务，任务不在其中时什么也不做
+    virtual void Remove(TimerTask *task) = 0;
+    //任务是否已经放入
+    virtual bool Queued(const TimerTask *task) const = 0;
+    //执行到期时间不晚于until的所有任务
+    virtual void Advance(uint64_t until) = 0;
+    //下一个需要唤醒的时间，没有任务时返回TIMER_NEVER
+    virtual uint64_t NextWakeup() const = 0;
+
+    //处理一个已经取出的到期任务，now是这次处理的时间
+    void Expire(TimerTask *task, uint64_t now) {
+        //空闲超时任务期间有过活动，还没有真正超时，按最近活跃时间重新放入
+        if (task->ActiveStamp()) {
+            uint64_t expire = *task->ActiveStamp() + task->DelayTime();
+            if (expire > now) {
+                task->SetExpire(expire);
+                Insert(task);
+                return ;
+            }
+        }
+        if (task->Repeat()) return RunRepeat(task, now);
+        //先从表中移除再执行，任务中可以添加同ID的定时任务
+        _timers.erase(task->Id());
+        task->Run();
+        DeleteTask(task);
+    }
+    //周期任务执行期间留在表中，可以在任务中取消自己；没有被取消时按原来的节拍放回去，落后太多时跳过错过的周期
+    void RunRepeat(TimerTask *task, uint64_t now) {
+        _running = task;
+        task->Run();
+        if (_running != task) {
+            DeleteTask(task);
+            return ;
+        }
+        _running = nullptr;
+        if (Queued(task)) return ;//任务中刷新过自己，已经重新放入
+        uint64_t expire = task->Expire() + task->DelayTime();
+        task->SetExpire(expire > now ? expire : now + task->DelayTime());
+        Insert(task);
+    }
+
+    void OnTime() {
+        if (ReadTimefd() > 0) _armed = TIMER_NEVER;//单次定时已经触发
+        _ticking = true;
+        Advance(NowMs());
+        _ticking = false;
+        Arm(NextWakeup());
+    }
+
+    //同ID的定时任务已经存在时替换掉；stamp不为空时是空闲超时任务，从*stamp开始计算延迟
+    void TimerAddInLoop(uint64_t id, uint32_t delay, TaskFunc cb, const uint64_t *stamp) {
+        TimerAddAtInLoop(id, (stamp ? *stamp : NowMs()) + delay, delay, std::move(cb), stamp, false);
+    }
+    //在绝对时间expire执行，repeat为真时之后每隔delay毫秒执行一次
+    void TimerAddAtInLoop(uint64_t id, uint64_t expire, uint32_t delay, TaskFunc cb, const uint64_t *stamp, bool repeat) {
+        TimerCancelInLoop(id);
+        TimerTask *task = NewTask(id, delay, std::move(cb), stamp, repeat);
+        task->SetExpire(expire);
+        _timers[id] = task;
+        ArmIfEarlier(Insert(task));
+    }
+
+    //从现在开始重新计算延迟时间
+    void TimerRefreshInLoop(uint64_t id) {
+        auto it = _timers.find(id);
+        if (it == _timers.end()) {
+            return;
+        }
+        TimerTask *task = it->second;
+        Remove(task);
+        task->SetExpire(NowMs() + task->DelayTime());
+        ArmIfEarlier(Insert(task));
+    }
+
+    //立即移除，不会再执行；timerfd不重新设置，提前唤醒一次没有影响
+    void TimerCancelInLoop(uint64_t id) {
+        auto it = _timers.find(id);
+        if (it == _timers.end()) {
+            return;
+        }
+        TimerTask *task = it->second;
+        _timers.erase(it);
+        Remove(task);
+        if (task == _running) {
+            _running = nullptr;//正在执行，执行完由RunRepeat释放
+            return ;
+        }
+        DeleteTask(task);
+    }
+
+public:
+    explicit TimerQueue(EventLoop *loop) : _armed(TIMER_NEVER), _ticking(false),
+                                  _auto_id(0), _running(nullptr),
+                                  _loop(loop),
+                                  _timerfd(CreateTimerfd()),
+                                  _timer_channel(std::make_unique<Channel>(_loop, _timerfd)) {
+        _timer_channel->SetReadCallback([this] { OnTime(); });
+        _timer_channel->EnableRead();
+    }
+    virtual ~TimerQueue() {
+        for (auto &it : _timers) {
+            DeleteTask(it.second);
+        }
+    }
+    /*定时器中有个_timers成员，定时器信息的操作有可能在多线程中进行，因此需要考虑线程安全问题*/
+    /*如果不想加锁，那就把对定期的所有操作，都放到一个线程中进行*/
+    //delay的单位是毫秒
+    void TimerAdd(uint64_t id, uint32_t delay, TaskFunc cb, const uint64_t *stamp = nullptr);
+    //expire是CLOCK_MONOTONIC毫秒的绝对时间，interval不为0时是周期任务
+    void TimerAddAt(uint64_t id, uint64_t expire, uint32_t interval, TaskFunc cb);
+    //分配一个不会和使用者指定的ID冲突的定时任务ID，可以在任意线程调用
+    uint64_t NewTimerId() { return TIMER_AUTO_ID | (_auto_id.fetch_add(1, std::memory_order_relaxed) + 1); }
+
+    void TimerRefresh(uint64_t id);
+
+    void TimerCancel(uint64_t id);
+
+    /*这个接口存在线程安全问题--这个接口实际上不能被外界使用者调用，只能在模块内，在对应的EventLoop线程内执行*/
+    bool HasTimer(uint64_t id) {
+        auto it = _timers.find(id);
+        if (it == _timers.end()) {
+            return false;
+        }
+        return true;
+    }
+    //实际使用的定时器实现
+    virtual const char *Name() const = 0;
+};
@@ -0,0 +1,530 @@
+#pragma once
+
+#include "Poller.hpp"
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 256                   //提交队列的大小，完成队列是它的两倍，满了先提交一次
+#define URING_IGNORE_DATA UINT64_MAX        //不需要处理完成事件的请求，比如取消监控
+#define URING_BUF_COUNT 256                 //接收缓冲区环中的缓冲区个数，必须是2的幂
+#define URING_BUF_SIZE 8192                 //每个接收缓冲区的大小，一个recv完成事件最多带这么多数据
+#define URING_BUF_GROUP 0                   //接收缓冲区环的组ID，每个io_uring只注册一个
+#define URING_SEND_IOVEC 64                 //一个sendmsg请求最多的分段个数，更多的分段拆成链接在一起的多个请求
+
+#ifndef IORING_FEAT_REG_REG_RING
+#define IORING_FEAT_REG_REG_RING (1U << 13)
+#endif
+
+//基于io_uring的事件监控和I/O，所有请求都随等待的io_uring_enter一起提交，一轮只有一次系统调用
+//1. 事件监控：和epoll一样是就绪通知模型，监控请求用IORING_OP_POLL_ADD，不再单独调用epoll_ctl
+//   水平触发用单次的poll请求，完成之后在下一次等待之前重新提交，重新提交时内核会立即检查一次就绪状态
+//   边缘触发用multishot的poll请求，提交一次之后每次有新的事件都会产生一个完成事件
+//2. 完成通知的I/O(内核6.3以上)：ChannelIo::ACCEPT/RECV的Channel启动读事件时提交multishot的accept/recv请求，
+//   内核直接完成accept和recv，每个新连接、每块数据一个完成事件，连接暂停读取时取消请求
+//   recv的数据放在注册给内核的接收缓冲区环中，完成回调把数据追加到连接的输入缓冲区之后立即把缓冲区还给环
+//   发送用带MSG_WAITALL的sendmsg，内核一直发送到全部完成或者出错；分段多时拆成链接在一起的多个请求，
+//   按顺序发送，每完成一个就可以释放已经发出的分段，一个失败后面的都会被取消
+//poll请求的user_data是描述符加上代数(最低位为1)，描述符被关闭复用或者请求被取消之后，旧请求晚到的完成事件按代数丢弃
+//I/O请求的user_data是请求对象的地址，Channel被移除后请求和它脱离，之后的完成事件只用来回收资源
+class UringPoller : public Poller {
+private:
+    //I/O请求的类型
+    enum class OpType {
+        ACCEPT,
+        RECV,
+        SEND
+    };
+    //一个I/O请求(发送时是一条请求链)，从提交到最后一个完成事件一直有效，之后放回空闲列表复用
+    struct Op {
+        OpType type;
+        int fd;
+        Channel *channel;               //Channel被移除后为空
+        bool cancelled;                 //已经提交了取消请求
+        int pending;                    //发送链中还没有完成的请求个数
+        int error;                      //发送链中第一个失败的结果
+        std::shared_ptr<void> hold;     //发送完成之前一直持有，保证数据有效
+        std::vector<struct iovec> iov;
+        std::vector<struct msghdr> msgs;
+    };
+    //收到的I/O完成事件，处理完就绪事件之后再处理
+    struct Completion {
+        Op *op;
+        int32_t res;
+        uint32_t flags;
+    };
+    struct Slot {
+        uint32_t gen = 0;           //当前poll请求的代数
+        bool armed = false;         //内核中是否有这个描述符的poll请求
+        uint32_t poll_events = 0;   //内核中poll请求监控的事件
+        bool multishot = false;
+        uint64_t round = 0;         //最近一次加入就绪列表的轮次，一轮中多个完成事件合并成一个
+        Op *read_op = nullptr;      //当前的accept/recv请求，包括正在取消的
+        bool read_ended = false;    //recv读到了结尾或者出错，不再自动重新提交，关闭读取之后恢复
+        Op *send_op = nullptr;      //正在进行的发送
+    };
+    int _ring_fd;
+    void *_ring_ptr;
+    size_t _ring_size;
+    struct io_uring_sqe *_sqes;
+    size_t _sqes_size;
+    //提交队列
+    unsigned *_sq_head;
+    unsigned *_sq_tail;
+    unsigned *_sq_mask;
+    unsigned *_sq_array;
+    unsigned _sq_entries;
+    //完成队列
+    unsigned *_cq_head;
+    unsigned *_cq_tail;
+    unsigned *_cq_mask;
+    struct io_uring_cqe *_cqes;
+    std::vector<Slot> _slots;   //按描述符下标保存请求状态，和Channel不同，描述符被复用时不清除，代数一直递增
+    uint64_t _round;
+    //接收缓冲区环
+    bool _async_io;
+    struct io_uring_buf_ring *_buf_ring;
+    char *_bufs;
+    uint16_t _buf_tail;
+    std::vector<Completion> _completions;
+    std::vector<std::unique_ptr<Op>> _ops;  //所有请求对象
+    std::vector<Op *> _free_ops;
+private:
+    static uint64_t Key(int fd, uint32_t gen) { return ((uint64_t)gen << 32) | ((uint64_t)(uint32_t)fd << 1) | 1; }
+    static int Enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+    }
+    Slot &SlotOf(int fd) {
+        if ((size_t)fd >= _slots.size()) _slots.resize(fd + 1);
+        return _slots[fd];
+    }
+    unsigned Pending() { return *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE); }
+    //把提交队列中的请求交给内核，不等待
+    void Submit() {
+        while (Pending() > 0) {
+            Add(_stats.ctl_calls, 1);
+            int ret = Enter(_ring_fd, Pending(), 0, 0);
+            if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                ERR_LOG("IO_URING SUBMIT FAILED:%s", strerror(errno));
+                abort();
+            }
+        }
+    }
+    struct io_uring_sqe *GetSqe() {
+        if (Pending() == _sq_entries) Submit();
+        unsigned tail = *_sq_tail;
+        unsigned idx = tail & *_sq_mask;
+        struct io_uring_sqe *sqe = &_sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        _sq_array[idx] = idx;
+        __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+        Add(_stats.submitted, 1);
+        return sqe;
+    }
+    void PrepPollAdd(int fd, Slot &slot, uint32_t events, bool multishot) {
+        struct io_uring_sqe *sqe = GetSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = events;
+        sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+        sqe->user_data = Key(fd, ++slot.gen);
+        slot.armed = true;
+        slot.poll_events = events;
+        slot.multishot = multishot;
+    }
+    //取消内核中的poll请求，代数加一，已经在完成队列中的旧事件都会被丢弃
+    void PrepPollRemove(int fd, Slot &slot) {
+        struct io_uring_sqe *sqe = GetSqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = Key(fd, slot.gen);
+        sqe->user_data = URING_IGNORE_DATA;
+        slot.gen++;
+        slot.armed = false;
+    }
+    Op *NewOp(OpType type, int fd, Channel *channel) {
+        if (_free_ops.empty()) {
+            _ops.push_back(std::make_unique<Op>());
+            _free_ops.push_back(_ops.back().get());
+        }
+        Op *op = _free_ops.back();
+        _free_ops.pop_back();
+        op->type = type;
+        op->fd = fd;
+        op->channel = channel;
+        op->cancelled = false;
+        op->pending = 1;
+        op->error = 0;
+        return op;
+    }
+    //最后一个完成事件处理完之后调用，释放持有的数据放在最后，连接可能在这时才析构
+    void FreeOp(Op *op) {
+        op->channel = nullptr;
+        _free_ops.push_back(op);
+        std::shared_ptr<void> hold = std::move(op->hold);
+    }
+    //取消一个请求的所有部分：multishot请求和发送链中还没有完成的请求
+    //取消和之后复用这个对象的新请求在同一批中时，取消在前，不会取消到新请求
+    void PrepCancel(Op *op) {
+        struct io_uring_sqe *sqe = GetSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)op;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = URING_IGNORE_DATA;
+        op->cancelled = true;
+    }
+    //multishot accept，新连接直接设置为非阻塞并且exec时关闭，和Socket::Accept一致
+    void PrepAccept(Op *op) {
+        struct io_uring_sqe *sqe = GetSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = op->fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->user_data = (uint64_t)op;
+    }
+    //multishot recv，内核从接收缓冲区环中选择缓冲区
+    void PrepRecv(Op *op) {
+        struct io_uring_sqe *sqe = GetSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = op->fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUF_GROUP;
+        sqe->user_data = (uint64_t)op;
+    }
+    bool AsyncRead(Channel *channel) { return _async_io && channel->IoMode() != ChannelIo::READY; }
+    //启动或者停止accept/recv请求，返回是否提交了请求
+    //正在取消的请求结束之前不提交新请求，结束时会重新检查
+    bool ApplyRead(int fd, Slot &slot, Channel *channel, bool want) {
+        if (!want) {
+            slot.read_ended = false;
+            if (slot.read_op == nullptr || slot.read_op->cancelled) return false;
+            PrepCancel(slot.read_op);
+            return true;
+        }
+        if (slot.read_op || slot.read_ended) return false;
+        if (channel->IoMode() == ChannelIo::ACCEPT) {
+            slot.read_op = NewOp(OpType::ACCEPT, fd, channel);
+            PrepAccept(slot.read_op);
+        }else {
+            slot.read_op = NewOp(OpType::RECV, fd, channel);
+            PrepRecv(slot.read_op);
+        }
+        return true;
+    }
+    //监控事件没有变化并且请求还在内核中时不需要提交；单次请求完成之后需要重新提交
+    //事件有变化时先取消旧请求再提交新请求，两个请求按顺序在同一批中提交
+    bool ApplyPoll(int fd, Slot &slot, uint32_t events, bool multishot) {
+        if (slot.armed && slot.poll_events == events && slot.multishot == multishot) return false;
+        if (!slot.armed && events == 0) return false;
+        if (slot.armed) PrepPollRemove(fd, slot);
+        if (events) PrepPollAdd(fd, slot, events, multishot);
+        return true;
+    }
+    //完成通知的Channel读取由accept/recv请求负责，poll只监控剩下的事件
+    //添加过的Channel没有监控事件时保留一个只等挂断和错误的multishot请求，和epoll的空事件一样，暂停读取的连接也能发现对端挂断
+    //正在recv的连接由recv发现挂断和错误，不需要这个请求
+    void ApplyChange(Channel *channel) override {
+        channel->SetDirty(false);
+        int fd = channel->Fd();
+        Slot &slot = SlotOf(fd);
+        uint32_t events = channel->NoneEvent() ? 0 : channel->Events();
+        if (events == 0 && channel->State() != ChannelState::ADDED) {
+            Add(_stats.skipped_updates, 1);
+            return ;
+        }
+        uint32_t poll = events & ~EPOLLET;
+        bool multishot = channel->EdgeTriggered();
+        bool reading = false;
+        bool changed = false;
+        if (AsyncRead(channel)) {
+            reading = poll & EPOLLIN;
+            changed = ApplyRead(fd, slot, channel, reading);
+            poll &= ~EPOLLIN;
+        }
+        if (poll == 0 && !reading) {
+            poll = EPOLLERR | EPOLLHUP;
+            multishot = true;
+        }
+        changed |= ApplyPoll(fd, slot, poll, multishot);
+        if (!changed) Add(_stats.skipped_updates, 1);
+        channel->SetState(ChannelState::ADDED);
+        channel->SetRegistered(events);
+    }
+    void HandleCqe(const struct io_uring_cqe *cqe, std::vector<Channel*> *active) {
+        if (cqe->user_data == URING_IGNORE_DATA) return ;
+        if (!(cqe->user_data & 1)) {
+            //I/O请求的完成事件，接收缓冲区在处理之前不会还给内核
+            _completions.push_back({(Op *)cqe->user_data, cqe->res, cqe->flags});
+            return ;
+        }
+        int fd = (int)((uint32_t)cqe->user_data >> 1);
+        uint32_t gen = (uint32_t)(cqe->user_data >> 32);
+        Channel *channel = FindChannel(fd);
+        if (channel == nullptr || _slots[fd].gen != gen) return ;
+        Slot &slot = _slots[fd];
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            //请求已经结束，下一次等待之前重新提交
+            slot.armed = false;
+            MarkDirty(channel);
+        }
+        if (cqe->res < 0) {
+            if (cqe->res != -ECANCELED) ERR_LOG("IO_URING POLL FAILED:%s", strerror(-cqe->res));
+            return ;
+        }
+        uint32_t revents = (uint32_t)cqe->res;
+        //内核总会附带EPOLLRDHUP等事件，只等挂断和错误的请求只关心这两个
+        if (slot.poll_events == (EPOLLERR | EPOLLHUP)) {
+            revents &= EPOLLERR | EPOLLHUP;
+            if (revents == 0) return ;
+        }
+        if (slot.round == _round) {
+            channel->SetREvents(channel->REvents() | revents);
+            return ;
+        }
+        slot.round = _round;
+        channel->SetREvents(revents);//设置实际就绪的事件
+        active->push_back(channel);
+    }
+    void Reap(std::vector<Channel*> *active) {
+        unsigned head = *_cq_head;
+        unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            HandleCqe(&_cqes[head & *_cq_mask], active);
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+    }
+    bool CqEmpty() { return *_cq_head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE); }
+    //把缓冲区放回接收缓冲区环的尾部
+    //环的内存就是io_uring_buf数组(tail和第一项的resv重叠)，C++下头文件里的bufs成员前面多出一个空结构体，偏移不对，不能用
+    void RecycleBuf(uint16_t bid) {
+        struct io_uring_buf *buf = reinterpret_cast<struct io_uring_buf *>(_buf_ring) + (_buf_tail & (URING_BUF_COUNT - 1));
+        buf->addr = (uint64_t)(_bufs + (size_t)bid * URING_BUF_SIZE);
+        buf->len = URING_BUF_SIZE;
+        buf->bid = bid;
+        _buf_tail++;
+        __atomic_store_n(&_buf_ring->tail, _buf_tail, __ATOMIC_RELEASE);
+    }
+    //accept/recv请求结束：还和Channel关联时在下一次等待之前重新检查，仍然需要读取并且没有读到结尾就重新提交
+    void EndRead(Op *op, bool ended) {
+        if (op->channel) {
+            Slot &slot = _slots[op->fd];
+            slot.read_op = nullptr;
+            slot.read_ended = ended;
+            MarkDirty(op->channel);
+        }
+        FreeOp(op);
+    }
+    //发送链中每个请求完成时通知发出去的字节数，整条链结束时再通知一次结果：0或者第一个失败的错误码
+    //MSG_WAITALL下只有出错才会少发，失败的请求之后链上的请求都以-ECANCELED结束
+    void EndSend(Op *op, int res) {
+        op->pending--;
+        if (res < 0 && op->error == 0) op->error = res;
+        if (op->channel && res > 0) op->channel->HandleSent(res, false);
+        if (op->pending > 0) return ;
+        if (op->channel) {
+            _slots[op->fd].send_op = nullptr;
+            op->channel->HandleSent(op->error, true);
+        }
+        FreeOp(op);
+    }
+    void Complete(const Completion &c) {
+        Op *op = c.op;
+        bool more = c.flags & IORING_CQE_F_MORE;
+        switch (op->type) {
+        case OpType::ACCEPT:
+            if (c.res != -ECANCELED) {
+                if (op->channel) op->channel->HandleAccepted(c.res);
+                else if (c.res >= 0) close(c.res);//已经停止监听，没有人接收的新连接
+            }
+            //出错时请求结束，由Acceptor决定立即重新提交还是暂停一段时间
+            if (!more) EndRead(op, false);
+            break;
+        case OpType::RECV: {
+            const char *data = nullptr;
+            uint16_t bid = 0;
+            if (c.flags & IORING_CQE_F_BUFFER) {
+                bid = c.flags >> IORING_CQE_BUFFER_SHIFT;
+                data = _bufs + (size_t)bid * URING_BUF_SIZE;
+            }
+            //接收缓冲区用完(-ENOBUFS)时请求结束，缓冲区还回来之后重新提交
+            bool retry = c.res > 0 || c.res == -ENOBUFS || c.res == -ECANCELED;
+            if (op->channel && c.res != -ENOBUFS && c.res != -ECANCELED) op->channel->HandleReceived(data, c.res);
+            if (data) RecycleBuf(bid);
+            if (!more) EndRead(op, !retry);
+            break;
+        }
+        case OpType::SEND:
+            EndSend(op, c.res);
+            break;
+        }
+    }
+    void ReleaseBufRing() {
+        if (_bufs) munmap(_bufs, (size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+        if (_buf_ring) munmap(_buf_ring, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+        _bufs = nullptr;
+        _buf_ring = nullptr;
+    }
+    //申请接收缓冲区并注册缓冲区环，失败时只使用poll
+    bool SetupBufRing() {
+        void *ring = mmap(nullptr, URING_BUF_COUNT * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) return false;
+        _buf_ring = static_cast<struct io_uring_buf_ring *>(ring);
+        void *bufs = mmap(nullptr, (size_t)URING_BUF_COUNT * URING_BUF_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (bufs == MAP_FAILED) {
+            ReleaseBufRing();
+            return false;
+        }
+        _bufs = static_cast<char *>(bufs);
+        struct io_uring_buf_reg reg{};
+        reg.ring_addr = (uint64_t)_buf_ring;
+        reg.ring_entries = URING_BUF_COUNT;
+        reg.bgid = URING_BUF_GROUP;
+        if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            ReleaseBufRing();
+            return false;
+        }
+        for (uint16_t bid = 0; bid < URING_BUF_COUNT; bid++) RecycleBuf(bid);
+        return true;
+    }
+    void Release() {
+        ReleaseBufRing();
+        if (_sqes) munmap(_sqes, _sqes_size);
+        if (_ring_ptr) munmap(_ring_ptr, _ring_size);
+        if (_ring_fd >= 0) close(_ring_fd);
+        _sqes = nullptr;
+        _ring_ptr = nullptr;
+        _ring_fd = -1;
+    }
+    //创建io_uring并映射队列，失败时Ok()返回false，由调用者退回epoll
+    //需要单次mmap、完成事件不丢弃和multishot poll(5.13)，用同一版本加入的IORING_FEAT_RSRC_TAGS判断
+    //完成通知的I/O需要multishot recv(6.0)、取消全部匹配的请求(5.19)和接收缓冲区环(5.19)，用6.3加入的IORING_FEAT_REG_REG_RING判断
+    void Setup() {
+        struct io_uring_params params{};
+        _ring_fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+        if (_ring_fd < 0) return ;
+        uint32_t required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_RSRC_TAGS;
+        if ((params.features & required) != required) {
+            Release();
+            return ;
+        }
+        size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        _ring_size = std::max(sq_size, cq_size);
+        void *ptr = mmap(nullptr, _ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+        if (ptr == MAP_FAILED) {
+            Release();
+            return ;
+        }
+        _ring_ptr = ptr;
+        _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        ptr = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+        if (ptr == MAP_FAILED) {
+            Release();
+            return ;
+        }
+        _sqes = static_cast<struct io_uring_sqe *>(ptr);
+        char *base = static_cast<char *>(_ring_ptr);
+        _sq_head = (unsigned *)(base + params.sq_off.head);
+        _sq_tail = (unsigned *)(base + params.sq_off.tail);
+        _sq_mask = (unsigned *)(base + params.sq_off.ring_mask);
+        _sq_array = (unsigned *)(base + params.sq_off.array);
+        _sq_entries = params.sq_entries;
+        _cq_head = (unsigned *)(base + params.cq_off.head);
+        _cq_tail = (unsigned *)(base + params.cq_off.tail);
+        _cq_mask = (unsigned *)(base + params.cq_off.ring_mask);
+        _cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+        _async_io = (params.features & IORING_FEAT_REG_REG_RING) && SetupBufRing();
+        if (!_async_io) DBG_LOG("IO_URING ASYNC I/O UNAVAILABLE, USE POLL ONLY");
+    }
+public:
+    UringPoller():_ring_fd(-1), _ring_ptr(nullptr), _ring_size(0), _sqes(nullptr), _sqes_size(0), _round(0),
+                  _async_io(false), _buf_ring(nullptr), _bufs(nullptr), _buf_tail(0) {
+        Setup();
+    }
+    ~UringPoller() override { Release(); }
+    bool Ok() { return _ring_fd >= 0; }
+    //移除监控，取消请求随下一次等待提交，内核中的请求持有文件引用，描述符真正关闭会推迟到那时
+    //进行中的I/O请求和Channel脱离，之后的完成事件不再通知，发送持有的数据在最后一个完成事件之后释放
+    void RemoveEvent(Channel *channel) override {
+        Forget(channel);
+        int fd = channel->Fd();
+        if (fd >= 0 && (size_t)fd < _slots.size()) {
+            Slot &slot = _slots[fd];
+            if (slot.armed) PrepPollRemove(fd, slot);
+            else slot.gen++;
+            for (Op *op : {slot.read_op, slot.send_op}) {
+                if (op == nullptr) continue;
+                op->channel = nullptr;
+                if (!op->cancelled) PrepCancel(op);
+            }
+            slot.read_op = nullptr;
+            slot.send_op = nullptr;
+            slot.read_ended = false;
+        }
+        channel->SetState(ChannelState::NEW);
+        channel->SetRegistered(0);
+    }
+    //不阻塞时只提交积累的请求，然后直接读取完成队列，完成队列为空时不需要系统调用
+    void Poll(std::vector<Channel*> *active, bool block) override {
+        //先把上一轮积累的修改放进提交队列，和等待一起提交
+        ApplyChanges();
+        _round++;
+        if (block && CqEmpty()) {
+            Add(_stats.wait_calls, 1);
+            int ret = Enter(_ring_fd, Pending(), 1, IORING_ENTER_GETEVENTS);
+            if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                ERR_LOG("IO_URING ENTER ERROR:%s\n", strerror(errno));
+                abort();//退出程序
+            }
+        }else {
+            Submit();
+        }
+        Reap(active);
+    }
+    bool AsyncIo() const override { return _async_io; }
+    //分段多于URING_SEND_IOVEC时拆成链接在一起的多个请求，一条链必须在同一次提交中，提交队列放不下时先把已有的请求提交掉
+    void SubmitSend(Channel *channel, const struct iovec *iov, int cnt, std::shared_ptr<void> hold) override {
+        int fd = channel->Fd();
+        Slot &slot = SlotOf(fd);
+        assert(_async_io && slot.send_op == nullptr && cnt > 0);
+        int links = (cnt + URING_SEND_IOVEC - 1) / URING_SEND_IOVEC;
+        if (_sq_entries - Pending() < (unsigned)links) Submit();
+        Op *op = NewOp(OpType::SEND, fd, channel);
+        op->hold = std::move(hold);
+        op->pending = links;
+        op->iov.assign(iov, iov + cnt);
+        op->msgs.assign(links, msghdr{});
+        for (int i = 0; i < links; i++) {
+            struct msghdr &msg = op->msgs[i];
+            msg.msg_iov = op->iov.data() + i * URING_SEND_IOVEC;
+            msg.msg_iovlen = std::min(cnt - i * URING_SEND_IOVEC, URING_SEND_IOVEC);
+            struct io_uring_sqe *sqe = GetSqe();
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t)&msg;
+            sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+            sqe->user_data = (uint64_t)op;
+            if (i + 1 < links) sqe->flags = IOSQE_IO_LINK;
+        }
+        slot.send_op = op;
+    }
+    size_t Dispatch() override {
+        size_t n = _completions.size();
+        for (size_t i = 0; i < n; i++) Complete(_completions[i]);
+        _completions.clear();
+        Add(_stats.completions, n);
+        return n;
+    }
+    bool HasCompletions() const override { return !_completions.empty(); }
+    const char *Name() const override { return _async_io ? "io_uring" : "io_uring(poll)"; }
+};
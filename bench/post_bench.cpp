@@ -0,0 +1,104 @@
+//跨线程投递任务的吞吐
+//1. 队列本身：多个生产者线程投递，一个消费者线程不停取走执行，对比无锁MpscQueue和加锁的vector<std::function>
+//2. EventLoop::QueueInLoop：多个线程向一个EventLoop投递，统计吞吐和eventfd唤醒次数
+//用法: post_bench [生产者线程数] [每个线程投递的任务数]
+#include "Thread.hpp"
+#include <cinttypes>
+#include <functional>
+#include <mutex>
+
+using Clock = std::chrono::steady_clock;
+
+//原来的任务池：加锁的vector，消费者交换出整个vector后执行
+class MutexQueue {
+private:
+    std::mutex _mutex;
+    std::vector<std::function<void()>> _tasks;
+public:
+    void Push(std::function<void()> task) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(std::move(task));
+    }
+    size_t ConsumeAll() {
+        std::vector<std::function<void()>> tasks;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            tasks.swap(_tasks);
+        }
+        for (auto &task : tasks) task();
+        return tasks.size();
+    }
+};
+
+class LockFreeQueue {
+private:
+    MpscQueue<UniqueFunction<void()>> _tasks;
+public:
+    void Push(UniqueFunction<void()> task) { _tasks.Push(std::move(task)); }
+    size_t ConsumeAll() { return _tasks.ConsumeAll([](UniqueFunction<void()> &task) { task(); }); }
+};
+
+static double Seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void Report(const char *name, uint64_t posts, double sec) {
+    printf("%-12s %10" PRIu64 " posts %8.3f s %8.2f Mposts/s\n", name, posts, sec, posts / sec / 1e6);
+}
+
+template<typename Queue>
+static void BenchQueue(const char *name, int producers, int count) {
+    Queue queue;
+    std::atomic<uint64_t> ran{0};
+    uint64_t total = (uint64_t)producers * count;
+    auto start = Clock::now();
+    std::thread consumer([&] {
+        uint64_t done = 0;
+        while (done < total) {
+            if (queue.ConsumeAll() == 0) std::this_thread::yield();
+            done = ran.load(std::memory_order_relaxed);
+        }
+    });
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < count; i++) queue.Push([&ran] { ran.fetch_add(1, std::memory_order_relaxed); });
+        });
+    }
+    for (auto &t : threads) t.join();
+    consumer.join();
+    Report(name, total, Seconds(start));
+}
+
+static void BenchLoop(int producers, int count) {
+    auto *thread = new LoopThread;//EventLoop线程不会退出，和线程池一样不释放
+    EventLoop *loop = thread->GetLoop();
+    std::atomic<uint64_t> ran{0};
+    uint64_t total = (uint64_t)producers * count;
+    uint64_t wakeups = loop->Stats().wakeups.load();
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < count; i++) loop->QueueInLoop([&ran] { ran.fetch_add(1, std::memory_order_relaxed); });
+        });
+    }
+    for (auto &t : threads) t.join();
+    while (ran.load() < total) std::this_thread::yield();
+    double sec = Seconds(start);
+    Report("QueueInLoop", total, sec);
+    wakeups = loop->Stats().wakeups.load() - wakeups;
+    printf("%-12s %10" PRIu64 " eventfd wakeups, %.1f posts per wakeup\n", "", wakeups,
+           wakeups ? (double)total / wakeups : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    int producers = argc > 1 ? atoi(argv[1]) : 4;
+    int count = argc > 2 ? atoi(argv[2]) : 1000000;
+    printf("%d producers, %d posts each\n", producers, count);
+    BenchQueue<MutexQueue>("mutex+vector", producers, count);
+    BenchQueue<LockFreeQueue>("mpsc", producers, count);
+    BenchLoop(producers, count);
+    fflush(stdout);
+    _exit(0);
+}
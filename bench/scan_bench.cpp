@@ -0,0 +1,87 @@
+//换行扫描的吞吐：逐字节、SSE2、AVX2三种Scanner实现和memchr逐个查找的对比
+//1. 在一块数据中找出全部'\n'，每次最多记录BUFFER_LINE_CACHE个，和Buffer的用法一致
+//2. 用Buffer按行读取同样的数据(FindCRLF + GetLineAndPop)，连续和链式两种模式
+//用法: scan_bench [平均行长] [数据字节数]
+#include "Buffer.hpp"
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+#define SCAN_ROUNDS 20
+
+static double GBps(Clock::time_point start, Clock::time_point end, uint64_t bytes) {
+    return bytes / std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+//memchr逐个查找，作为对照
+static size_t CountMemchr(const std::string &data) {
+    size_t n = 0;
+    const char *p = data.data(), *end = p + data.size();
+    while ((p = (const char *)memchr(p, '\n', end - p)) != nullptr) {
+        n++;
+        p++;
+    }
+    return n;
+}
+
+static size_t CountScanner(ScanKernel kernel, const std::string &data) {
+    size_t n = 0;
+    size_t offs[BUFFER_LINE_CACHE];
+    const char *p = data.data(), *end = p + data.size(), *stop = nullptr;
+    while (p < end) {
+        n += Scanner::FindAllWith(kernel, p, end, '\n', offs, BUFFER_LINE_CACHE, &stop);
+        p = stop;
+    }
+    return n;
+}
+
+static size_t CountBuffer(BufferMode mode, const std::string &data) {
+    Buffer buf(mode);
+    buf.WriteAndPush(data.data(), data.size());
+    size_t n = 0;
+    while (buf.FindCRLF() != NULL) {
+        buf.GetLineAndPop();
+        n++;
+    }
+    return n;
+}
+
+template <typename F>
+static void Run(const char *name, const std::string &data, size_t expect, F func) {
+    size_t n = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < SCAN_ROUNDS; i++) n = func(data);
+    Clock::time_point end = Clock::now();
+    printf("%-18s %6.2f GB/s  lines=%zu%s\n", name, GBps(start, end, data.size() * SCAN_ROUNDS), n,
+           n == expect ? "" : "  MISMATCH");
+}
+
+int main(int argc, char *argv[]) {
+    size_t line_len = argc > 1 ? atoi(argv[1]) : 64;
+    size_t size = argc > 2 ? atoi(argv[2]) : 16 << 20;
+    //行长在平均值上下浮动，换行落在向量块内的各个位置
+    std::mt19937 rng(1);
+    std::string data(size, 'a');
+    for (size_t i = 0; i < size;) {
+        i += 1 + rng() % (2 * line_len);
+        if (i < size) data[i] = '\n';
+    }
+    size_t expect = CountMemchr(data);
+    printf("%zu bytes, average line %zu bytes, %zu lines\n", size, line_len, expect);
+    Run("memchr", data, expect, CountMemchr);
+    const std::pair<ScanKernel, const char *> kernels[] = {
+        {ScanKernel::SCALAR, "scanner scalar"},
+        {ScanKernel::SSE2, "scanner sse2"},
+        {ScanKernel::AVX2, "scanner avx2"},
+    };
+    for (auto &it : kernels) {
+        if (!Scanner::Supported(it.first)) continue;
+        Run(it.second, data, expect, [&it](const std::string &d) { return CountScanner(it.first, d); });
+    }
+    Run("buffer contiguous", data, expect, [](const std::string &d) { return CountBuffer(BufferMode::CONTIGUOUS, d); });
+    Run("buffer chained", data, expect, [](const std::string &d) { return CountBuffer(BufferMode::CHAINED, d); });
+    return 0;
+}
@@ -0,0 +1,83 @@
+//时间轮和四叉堆定时器在大量定时任务下的添加、取消和到期处理开销
+//每种定时器在自己的EventLoop线程中测试，只使用EventLoop的公开接口：
+//1. 添加N个定时任务，到期时间均匀分布在SPREAD_MS毫秒内
+//2. 保持N个任务不变，随机取消M个再重新添加M个
+//3. 让EventLoop线程睡到所有任务都到期，再启动EventLoop，一次处理完全部到期任务
+//用法: timer_bench [任务数] [取消/重新添加的个数] [到期时间分布的毫秒数]
+#include "Thread.hpp"
+#include <cinttypes>
+#include <random>
+#include <algorithm>
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    double insert_ns;
+    double cancel_ns;
+    double reinsert_ns;
+    double fire_ns;
+    uint64_t fired;
+    std::string name;
+};
+
+static double PerOp(Clock::time_point start, Clock::time_point end, uint64_t n) {
+    return std::chrono::duration<double, std::nano>(end - start).count() / n;
+}
+
+static Result Bench(TimerType type, uint64_t count, uint64_t churn, uint32_t spread_ms) {
+    Result result{};
+    std::atomic<bool> done{false};
+    std::thread([&] {
+        //在EventLoop线程中还没有Start时调用定时接口，都是直接添加，不经过任务池
+        EventLoop loop(PollerType::EPOLL, type);
+        std::mt19937_64 rng(42);
+        uint64_t fired = 0;
+        Clock::time_point fire_start;
+        auto task = [&] {
+            if (++fired < count) return;
+            result.fire_ns = PerOp(fire_start, Clock::now(), count);
+            result.fired = fired;
+            result.name = loop.TimerName();
+            done.store(true);
+        };
+        auto start = Clock::now();
+        for (uint64_t id = 1; id <= count; id++) {
+            loop.TimerAdd(id, std::chrono::milliseconds(1 + rng() % spread_ms), task);
+        }
+        result.insert_ns = PerOp(start, Clock::now(), count);
+
+        std::vector<uint64_t> ids(count);
+        for (uint64_t i = 0; i < count; i++) ids[i] = i + 1;
+        std::shuffle(ids.begin(), ids.end(), rng);
+        churn = std::min(churn, count);
+        start = Clock::now();
+        for (uint64_t i = 0; i < churn; i++) loop.TimerCancel(ids[i]);
+        auto mid = Clock::now();
+        for (uint64_t i = 0; i < churn; i++) {
+            loop.TimerAdd(ids[i], std::chrono::milliseconds(1 + rng() % spread_ms), task);
+        }
+        result.cancel_ns = PerOp(start, mid, churn);
+        result.reinsert_ns = PerOp(mid, Clock::now(), churn);
+
+        //所有任务都到期之后再开始处理
+        std::this_thread::sleep_for(std::chrono::milliseconds(spread_ms + 10));
+        fire_start = Clock::now();
+        loop.Start();
+    }).detach();//EventLoop线程不会退出
+    while (!done.load()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    uint64_t churn = argc > 2 ? strtoull(argv[2], nullptr, 10) : 200000;
+    uint32_t spread_ms = argc > 3 ? (uint32_t)atoi(argv[3]) : 5000;
+    printf("%" PRIu64 " timers over %u ms, %" PRIu64 " cancel+reinsert\n", count, spread_ms, churn);
+    for (TimerType type : {TimerType::WHEEL, TimerType::HEAP}) {
+        Result r = Bench(type, count, churn, spread_ms);
+        printf("%-6s insert %6.0f ns  cancel %6.0f ns  reinsert %6.0f ns  fire %6.0f ns  fired=%" PRIu64 "\n",
+               r.name.c_str(), r.insert_ns, r.cancel_ns, r.reinsert_ns, r.fire_ns, r.fired);
+    }
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,139 @@
+//水平触发和边缘触发下每个请求的系统调用次数
+//同一个进程里启动两个单线程回显服务器，一个水平触发一个边缘触发，客户端在主线程中对所有连接依次发送请求、等待回显
+//在程序中重新定义服务器用到的系统调用函数，服务器线程里的调用按种类计数后直接发起系统调用
+//用法: trigger_bench [连接数] [轮数] [请求字节数]
+#include "TcpServer.hpp"
+#include <cinttypes>
+#include <sys/epoll.h>
+
+enum { SYS_RECV, SYS_SEND, SYS_WAIT, SYS_CTL, SYS_OTHER, SYS_KINDS };
+static const char *kSysNames[SYS_KINDS] = {"recv", "send", "epoll_wait", "epoll_ctl", "read/write"};
+
+struct SyscallCount {
+    std::atomic<uint64_t> calls[SYS_KINDS]{};
+    uint64_t Total() const {
+        uint64_t total = 0;
+        for (auto &c : calls) total += c.load();
+        return total;
+    }
+};
+static thread_local SyscallCount *t_count = nullptr;    //只统计服务器线程
+static void Count(int kind) {
+    if (t_count) t_count->calls[kind].fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" {
+ssize_t recv(int fd, void *buf, size_t len, int flags) {
+    Count(SYS_RECV);
+    return syscall(SYS_recvfrom, fd, buf, len, flags, nullptr, nullptr);
+}
+ssize_t recvmsg(int fd, struct msghdr *msg, int flags) {
+    Count(SYS_RECV);
+    return syscall(SYS_recvmsg, fd, msg, flags);
+}
+ssize_t send(int fd, const void *buf, size_t len, int flags) {
+    Count(SYS_SEND);
+    return syscall(SYS_sendto, fd, buf, len, flags, nullptr, 0);
+}
+ssize_t sendmsg(int fd, const struct msghdr *msg, int flags) {
+    Count(SYS_SEND);
+    return syscall(SYS_sendmsg, fd, msg, flags);
+}
+int epoll_wait(int epfd, struct epoll_event *evs, int maxevents, int timeout) {
+    Count(SYS_WAIT);
+    return (int)syscall(SYS_epoll_pwait, epfd, evs, maxevents, timeout, nullptr, 8);
+}
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev) noexcept {
+    Count(SYS_CTL);
+    return (int)syscall(SYS_epoll_ctl, epfd, op, fd, ev);
+}
+ssize_t read(int fd, void *buf, size_t len) {
+    Count(SYS_OTHER);
+    return syscall(SYS_read, fd, buf, len);
+}
+ssize_t write(int fd, const void *buf, size_t len) {
+    Count(SYS_OTHER);
+    return syscall(SYS_write, fd, buf, len);
+}
+}
+
+//在自己的线程里运行一个单线程回显服务器，线程里的系统调用计入count
+static void RunServer(int port, bool edge, SyscallCount *count) {
+    std::thread([port, edge, count] {
+        t_count = count;
+        TcpServer server(port);
+        server.SetEdgeTriggered(edge);
+        server.SetMessageCallback([](const PtrConnection &conn, Buffer *buf) {
+            conn->Send(buf->ReadPosition(), buf->ReadableSize());
+            buf->MoveReadOffset(buf->ReadableSize());
+        });
+        server.Start();
+    }).detach();
+}
+
+static std::vector<Socket> Connect(int port, int conns) {
+    std::vector<Socket> socks(conns);
+    for (auto &sock : socks) {
+        //服务器线程可能还没有开始监听
+        while (!sock.CreateClient(port, "127.0.0.1")) {
+            sock.Close();
+            usleep(10000);
+        }
+    }
+    return socks;
+}
+
+//每一轮先给所有连接发送请求，再依次读回完整的回显，返回请求总数
+static uint64_t Drive(std::vector<Socket> &socks, int rounds, size_t size) {
+    std::string req(size, 'x');
+    std::string resp(size, 0);
+    for (int r = 0; r < rounds; r++) {
+        for (auto &sock : socks) sock.Send(req.data(), req.size());
+        for (auto &sock : socks) {
+            size_t got = 0;
+            while (got < size) {
+                ssize_t ret = sock.Recv(&resp[got], size - got);
+                if (ret <= 0) {
+                    fprintf(stderr, "ECHO FAILED\n");
+                    _exit(1);
+                }
+                got += ret;
+            }
+        }
+    }
+    return (uint64_t)rounds * socks.size();
+}
+
+static void Report(const char *name, const SyscallCount &before, const SyscallCount &after, uint64_t requests) {
+    printf("%-6s", name);
+    for (int i = 0; i < SYS_KINDS; i++) {
+        printf(" %s=%.2f", kSysNames[i], (double)(after.calls[i] - before.calls[i]) / requests);
+    }
+    printf(" total=%.2f per request\n", (double)(after.Total() - before.Total()) / requests);
+}
+
+static void Snapshot(const SyscallCount &from, SyscallCount *to) {
+    for (int i = 0; i < SYS_KINDS; i++) to->calls[i].store(from.calls[i].load());
+}
+
+int main(int argc, char *argv[]) {
+    int conns = argc > 1 ? atoi(argv[1]) : 64;
+    int rounds = argc > 2 ? atoi(argv[2]) : 1000;
+    size_t size = argc > 3 ? atoi(argv[3]) : 128;
+    static SyscallCount counts[2];
+    const char *names[2] = {"LT", "ET"};
+    printf("%d connections, %d rounds, %zu bytes per request\n", conns, rounds, size);
+    for (int mode = 0; mode < 2; mode++) {
+        int port = 9701 + mode;
+        RunServer(port, mode == 1, &counts[mode]);
+        std::vector<Socket> socks = Connect(port, conns);
+        Drive(socks, 10, size);//预热，连接都已经建立并注册
+        SyscallCount before, after;
+        Snapshot(counts[mode], &before);
+        uint64_t requests = Drive(socks, rounds, size);
+        Snapshot(counts[mode], &after);
+        Report(names[mode], before, after, requests);
+    }
+    fflush(stdout);
+    _exit(0);
+}
@@ -19,8 +19,14 @@ class Echo{
         }
     public:
         explicit Echo(int port):_server(port) {
-            _server.SetThreadCount(std::thread::hardware_concurrency());
-            _server.EnableInactiveRelease(10);
+            //baseloop独占进程允许的第一个CPU，其余每个允许的CPU一个从属EventLoop(cpuset/容器中不一定包含0号CPU)
+            std::vector<int> allowed = Affinity::AllowedCpus();
+            _server.SetThreadCount(allowed.size() > 1 ? (int)allowed.size() - 1 : 1);
+            LoopAffinity affinity;
+            affinity.enable = !allowed.empty();
+            affinity.base_cpu = allowed.empty() ? 0 : allowed.front();
+            _server.SetLoopAffinity(affinity);
+            _server.EnableInactiveRelease(std::chrono::seconds(10));
             _server.SetClosedCallback([this](auto && PH1) { OnClosed(std::forward<decltype(PH1)>(PH1)); });
             _server.SetConnectedCallback([this](auto && PH1) { OnConnected(std::forward<decltype(PH1)>(PH1)); });
             _server.SetMessageCallback([this](auto && PH1, auto && PH2) { OnMessage(std::forward<decltype(PH1)>(PH1), std::forward<decltype(PH2)>(PH2)); });
@@ -66,7 +66,7 @@ private:
 
     bool RecvHttpLine(Buffer &buf) {
         if (state_ != HttpRecvState::RECV_HTTP_LINE) { return false; }
-        auto line = buf.GetLine();
+        auto line = buf.GetLineAndPop();
         if (line.empty()) {
             if (buf.ReadableSize() > MAX_LINE) {
                 state_code_ = 414;
@@ -90,9 +90,19 @@ private:
 
     bool RecvHttpHead(Buffer &buf) {
         if (state_ != HttpRecvState::RECV_HTTP_HEAD) { return false; }
+        // headers not complete yet: wait for more data instead of parsing line by line,
+        // the buffer remembers how far it has scanned
+        if (buf.FindHeaderEnd() == nullptr) {
+            if (buf.FindCRLF() == nullptr && buf.ReadableSize() > MAX_LINE) {
+                state_ = HttpRecvState::RECV_HTTP_ERROR;
+                state_code_ = 414;
+                return false;
+            }
+            return true;
+        }
 
         while(true) {
-            auto line = buf.GetLine();
+            auto line = buf.GetLineAndPop();
             if (line.empty()) {
                 if (buf.ReadableSize() > MAX_LINE) {
                     state_ = HttpRecvState::RECV_HTTP_ERROR;
@@ -52,6 +52,10 @@ private:
         if (response.redirect_) {
             response.SetHeader("Location", response.redirect_url_);
         }
+        //在连接所属的EventLoop线程中执行，Date头直接用这个线程按秒缓存的字符串
+        if (!response.HasHeader("Date")) {
+            response.SetHeader("Date", LoopClock::Local().HttpDate());
+        }
 
         std::stringstream rsp_str;
         rsp_str << request.version_ << " " << std::to_string(response.state_code_)
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+//测试用的检查，失败时打印位置和表达式，以非0退出码结束进程，ctest据此判断失败
+#define CHECK(cond) do {\
+        if (cond) break;\
+        fprintf(stderr, "%s:%d CHECK FAILED: %s\n", __FILE__, __LINE__, #cond);\
+        exit(1);\
+    } while (0)
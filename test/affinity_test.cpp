@@ -0,0 +1,59 @@
+//从属EventLoop的CPU分配：自动分配时不能落在baseloop的CPU上
+#include "Check.hpp"
+#include "ThreadPool.hpp"
+#include <future>
+
+using Cpus = std::vector<int>;
+
+static void TestPlan() {
+    LoopAffinity affinity;
+    affinity.enable = true;
+    affinity.base_cpu = 0;
+    //baseloop绑定之前进程允许0~3，从属EventLoop使用其余的CPU
+    CHECK(Affinity::PlanLoopCpus(affinity, {0, 1, 2, 3}) == Cpus({1, 2, 3}));
+    //只有一个CPU时只能共用
+    CHECK(Affinity::PlanLoopCpus(affinity, {0}) == Cpus({0}));
+    //baseloop不在允许的CPU中时全部可用
+    CHECK(Affinity::PlanLoopCpus(affinity, {2, 3}) == Cpus({2, 3}));
+    //指定的CPU原样使用
+    affinity.cpus = {0, 5};
+    CHECK(Affinity::PlanLoopCpus(affinity, {0, 1, 2, 3}) == Cpus({0, 5}));
+    affinity.enable = false;
+    CHECK(Affinity::PlanLoopCpus(affinity, {0, 1, 2, 3}).empty());
+}
+
+//在loop所在线程中读取线程允许运行的CPU
+static Cpus LoopAllowed(EventLoop *loop) {
+    std::promise<Cpus> result;
+    loop->RunInLoop([&result] { result.set_value(Affinity::AllowedCpus()); });
+    return result.get_future().get();
+}
+
+//实际创建线程池：baseloop绑定之后，从属EventLoop仍然分布在其他CPU上
+static void TestCreate() {
+    Cpus allowed = Affinity::AllowedCpus();
+    CHECK(!allowed.empty());
+    EventLoop base;
+    LoopThreadPool pool(&base);
+    LoopAffinity affinity;
+    affinity.enable = true;
+    affinity.base_cpu = allowed.front();
+    affinity.numa_local = false;
+    pool.SetAffinity(affinity);
+    int count = allowed.size() > 1 ? (int)allowed.size() - 1 : 1;
+    pool.SetThreadCount(count);
+    pool.Create();
+    CHECK(Affinity::AllowedCpus() == Cpus({affinity.base_cpu}));
+    for (auto loop : pool.AllLoops()) {
+        Cpus cpus = LoopAllowed(loop);
+        CHECK(cpus.size() == 1);
+        if (allowed.size() > 1) CHECK(cpus[0] != affinity.base_cpu);
+    }
+}
+
+int main() {
+    TestPlan();
+    TestCreate();
+    printf("affinity_test passed\n");
+    return 0;
+}
@@ -0,0 +1,91 @@
+//投递和执行任务的常见路径上没有堆内存申请
+//替换全局的operator new，按线程统计申请次数；内存池缓存不足时向系统申请也会被统计到
+#include "Check.hpp"
+#include "Thread.hpp"
+#include <new>
+
+static thread_local uint64_t t_allocs = 0;
+
+void *operator new(size_t size) {
+    t_allocs++;
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+#define POST_COUNT 100
+#define WARM_ROUNDS 3
+
+//在loop中执行f，等待执行完毕
+template<typename F>
+static void RunAndWait(EventLoop *loop, F f) {
+    std::atomic<bool> done{false};
+    loop->QueueInLoop([&f, &done] {
+        f();
+        done.store(true);
+    });
+    while (!done.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+//EventLoop线程给自己投递任务：QueueInLoop和RunInLoop都不申请内存，任务执行时也不申请
+static void TestLoopThread(EventLoop *loop) {
+    uint64_t post_allocs = 0;
+    std::atomic<uint64_t> begin{0}, end{0};
+    std::atomic<int> ran{0};
+    for (int round = 0; round <= WARM_ROUNDS; round++) {
+        RunAndWait(loop, [&] {
+            int x = 0;
+            void *a = &x, *b = &x;
+            uint64_t c = 1;
+            uint64_t before = t_allocs;
+            //第一个任务记录执行开始时的计数，最后一个记录结束时的计数
+            loop->QueueInLoop([&begin] { begin.store(t_allocs); });
+            for (int i = 0; i < POST_COUNT; i++) loop->QueueInLoop([a, b, c, &ran] { ran += (a == b) + c; });
+            for (int i = 0; i < POST_COUNT; i++) loop->RunInLoop([a, b, c, &ran] { ran += (a == b) + c; });
+            loop->QueueInLoop([&end] { end.store(t_allocs); });
+            post_allocs = t_allocs - before;
+        });
+        //等待本轮投递的任务都执行完
+        RunAndWait(loop, [] {});
+    }
+    printf("loop thread: post allocs=%lu dispatch allocs=%lu\n",
+           (unsigned long)post_allocs, (unsigned long)(end - begin));
+    CHECK(post_allocs == 0);
+    CHECK(end - begin == 0);
+    CHECK(ran == (WARM_ROUNDS + 1) * POST_COUNT * 4);
+}
+
+//其他线程投递任务：节点从投递线程的内存池申请，执行后还回来，预热之后投递也不申请内存
+//投递期间让EventLoop停在一个任务里，每一轮同时存在的节点个数固定，预热之后内存池里的节点一定够用
+static void TestOtherThread(EventLoop *loop) {
+    std::atomic<int> ran{0};
+    uint64_t post_allocs = 0;
+    for (int round = 0; round <= WARM_ROUNDS; round++) {
+        std::atomic<int> gate{0};
+        loop->QueueInLoop([&gate] {
+            gate.store(1);
+            while (gate.load() != 2) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+        while (gate.load() != 1) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        int target = ran.load() + POST_COUNT;
+        uint64_t before = t_allocs;
+        for (int i = 0; i < POST_COUNT; i++) loop->QueueInLoop([&ran] { ran++; });
+        post_allocs = t_allocs - before;
+        gate.store(2);
+        while (ran.load() < target) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    printf("other thread: post allocs=%lu\n", (unsigned long)post_allocs);
+    CHECK(post_allocs == 0);
+}
+
+int main() {
+    LoopThread thread;
+    EventLoop *loop = thread.GetLoop();
+    TestLoopThread(loop);
+    TestOtherThread(loop);
+    printf("alloc_test passed\n");
+    fflush(stdout);
+    _exit(0);//EventLoop线程不会退出
+}
@@ -0,0 +1,122 @@
+//Scanner的SSE2/AVX2实现和逐字节实现结果一致，Buffer跨分段边界查找换行和空行的结果和直接查找一致
+#include "Check.hpp"
+#include "Buffer.hpp"
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+static const ScanKernel kKernels[] = {ScanKernel::SSE2, ScanKernel::AVX2};
+
+//用kernel和逐字节实现扫描同一段数据，比较找到的偏移和停止位置
+static void Compare(ScanKernel kernel, const char *begin, const char *end, char ch, size_t max) {
+    std::vector<size_t> expect(max + 1), actual(max + 1);
+    const char *expect_stop = nullptr, *actual_stop = nullptr;
+    size_t n = Scanner::FindAllWith(ScanKernel::SCALAR, begin, end, ch, expect.data(), max, &expect_stop);
+    size_t m = Scanner::FindAllWith(kernel, begin, end, ch, actual.data(), max, &actual_stop);
+    CHECK(n == m);
+    CHECK(expect_stop == actual_stop);
+    for (size_t i = 0; i < n; i++) CHECK(expect[i] == actual[i]);
+}
+
+//起始地址在一个向量块内的每种对齐，长度跨过16/32字节块的边界，匹配落在块的首尾
+static void TestBoundaries(ScanKernel kernel) {
+    alignas(64) char buf[256];
+    for (size_t align = 0; align < 64; align++) {
+        for (size_t len = 0; len + align <= sizeof(buf) && len <= 130; len++) {
+            for (size_t pos : {(size_t)0, (size_t)15, (size_t)16, (size_t)31, (size_t)32, (size_t)63, len - 1}) {
+                memset(buf, 'a', sizeof(buf));
+                if (pos < len) buf[align + pos] = '\n';
+                //数据范围之外的匹配不能被算进去
+                if (align > 0) buf[align - 1] = '\n';
+                if (align + len < sizeof(buf)) buf[align + len] = '\n';
+                for (size_t max : {(size_t)1, (size_t)2, (size_t)32}) {
+                    Compare(kernel, buf + align, buf + align + len, '\n', max);
+                }
+            }
+        }
+    }
+}
+
+//随机数据，匹配密集时max会在一个块的中间截断
+static void TestRandom(ScanKernel kernel) {
+    std::mt19937 rng(5);
+    std::string data(4096 + 64, 'a');
+    for (int round = 0; round < 2000; round++) {
+        int density = 1 + rng() % 64;
+        for (auto &c : data) c = rng() % density == 0 ? '\n' : 'a' + rng() % 4;
+        size_t align = rng() % 64;
+        size_t len = rng() % (data.size() - align + 1);
+        size_t max = 1 + rng() % 64;
+        Compare(kernel, data.data() + align, data.data() + align + len, '\n', max);
+        Compare(kernel, data.data() + align, data.data() + align + len, 'b', max);
+    }
+}
+
+//从行首开始找第一个空行，作为Buffer查找的对照
+static const char *NaiveEmptyLine(const char *begin, const char *end) {
+    const char *line = begin;
+    for (const char *p = begin; p < end; p++) {
+        if (*p != '\n') continue;
+        if (p == line || (p == line + 1 && *line == '\r')) return p + 1;
+        line = p + 1;
+    }
+    return nullptr;
+}
+
+//链式Buffer的数据分散在多个分段中，换行和空行落在分段的边界附近
+static void TestBuffer(BufferMode mode) {
+    std::mt19937 rng(7);
+    const char alpha[] = "ab\r\n";
+    Buffer buf(mode);
+    std::string ref;
+    for (int it = 0; it < 100000; it++) {
+        int op = rng() % 5;
+        if (op == 0) {
+            //写入的长度经常正好凑满一个分段
+            size_t len = rng() % 2 ? rng() % 100 : BUFFER_SEGMENT_SIZE - ref.size() % BUFFER_SEGMENT_SIZE + rng() % 3 - 1;
+            std::string s(len, 'a');
+            for (auto &c : s) c = rng() % 10 == 0 ? alpha[2 + rng() % 2] : alpha[rng() % 2];
+            buf.WriteAndPush(s.data(), s.size());
+            ref += s;
+        } else if (op == 1) {
+            char *p = buf.FindCRLF();
+            size_t q = ref.find('\n');
+            if (q == std::string::npos) CHECK(p == NULL);
+            else CHECK(p != NULL && (size_t)(p - buf.ReadPosition()) == q);
+        } else if (op == 2) {
+            char *p = buf.FindHeaderEnd();
+            const char *q = NaiveEmptyLine(ref.data(), ref.data() + ref.size());
+            if (q == nullptr) CHECK(p == NULL);
+            else CHECK(p != NULL && p - buf.ReadPosition() == q - ref.data());
+        } else if (op == 3) {
+            size_t n = ref.empty() ? 0 : rng() % (ref.size() + 1);
+            buf.MoveReadOffset(n);
+            ref.erase(0, n);
+        } else {
+            std::string line = buf.GetLineAndPop();
+            size_t q = ref.find('\n');
+            if (q == std::string::npos) {
+                CHECK(line.empty());
+            } else {
+                CHECK(line == ref.substr(0, q + 1));
+                ref.erase(0, q + 1);
+            }
+        }
+    }
+}
+
+int main() {
+    for (ScanKernel kernel : kKernels) {
+        if (!Scanner::Supported(kernel)) {
+            printf("kernel %d not supported, skipped\n", (int)kernel);
+            continue;
+        }
+        TestBoundaries(kernel);
+        TestRandom(kernel);
+    }
+    TestBuffer(BufferMode::CONTIGUOUS);
+    TestBuffer(BufferMode::CHAINED);
+    printf("scanner_test passed\n");
+    return 0;
+}
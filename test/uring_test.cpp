@@ -0,0 +1,93 @@
+//io_uring异步收发的回显：多条连接同时收发，数据量超过一条发送链的分段数，半关闭之后数据全部发回再关闭
+//内核不支持异步收发(退化为poll)时跳过
+#include "Check.hpp"
+#include "TcpServer.hpp"
+#include <arpa/inet.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#define URING_TEST_PORT 8650
+#define URING_TEST_CONNS 4
+#define URING_TEST_BYTES (3 << 20)
+#define URING_TEST_TIMEOUT 10       //秒，收发卡住时测试失败而不是一直等待
+
+static bool AsyncIoSupported() {
+    bool supported = false;
+    //EventLoop绑定所在线程，探测放在单独的线程里
+    std::thread([&supported] {
+        EventLoop loop(PollerType::URING);
+        supported = loop.AsyncIo();
+    }).join();
+    return supported;
+}
+
+static int Connect() {
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(URING_TEST_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int retry = 0; retry < 100; retry++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        CHECK(fd >= 0);
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            struct timeval tv{URING_TEST_TIMEOUT, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            return fd;
+        }
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+//发送线程写完数据后半关闭，接收到对端关闭为止，比较收到的数据
+static void Echo(int seed, bool *ok) {
+    std::mt19937 rng(seed);
+    std::string data(URING_TEST_BYTES, 0);
+    for (auto &c : data) c = (char)rng();
+    int fd = Connect();
+    CHECK(fd >= 0);
+    std::thread sender([fd, &data] {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            //每次写入的长度不同，服务端收到的分段边界也不同
+            ssize_t ret = send(fd, data.data() + sent, std::min(data.size() - sent, (size_t)(1000 + sent % 70000)), MSG_NOSIGNAL);
+            CHECK(ret > 0);
+            sent += ret;
+        }
+        shutdown(fd, SHUT_WR);
+    });
+    std::string got;
+    char buf[65536];
+    ssize_t ret;
+    while ((ret = recv(fd, buf, sizeof(buf), 0)) > 0) got.append(buf, ret);
+    sender.join();
+    close(fd);
+    *ok = got == data;
+}
+
+int main() {
+    if (!AsyncIoSupported()) {
+        printf("io_uring async io not supported, skipped\n");
+        return 0;
+    }
+    std::thread([] {
+        TcpServer server(URING_TEST_PORT, PollerType::URING);
+        server.SetThreadCount(2);
+        server.SetMessageCallback([](const PtrConnection &conn, Buffer *buf) {
+            std::string data = buf->ReadAsStringAndPop(buf->ReadableSize());
+            conn->Send(data.data(), data.size());
+        });
+        server.Start();
+    }).detach();
+    bool ok[URING_TEST_CONNS] = {};
+    std::vector<std::thread> clients;
+    for (int i = 0; i < URING_TEST_CONNS; i++) clients.emplace_back(Echo, i, &ok[i]);
+    for (auto &t : clients) t.join();
+    for (int i = 0; i < URING_TEST_CONNS; i++) CHECK(ok[i]);
+    printf("uring_test passed\n");
+    fflush(stdout);
+    _exit(0);//服务端的EventLoop线程不会退出
+}